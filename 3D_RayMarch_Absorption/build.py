@@ -18,7 +18,11 @@ LIBRARIES=""            # What libraries do we want to include
 if platform.system()=="Linux":
     ARGUMENTS="-D LINUX" # -D is a #define sent to preprocessor
     INCLUDE_DIR="-I ./include/ -I ./../../common/thirdparty/glm/"
-    LIBRARIES="-lSDL2 -ldl"
+    LIBRARIES="-lSDL2 -lEGL -ldl"
+    # The CPU renderers run 8-wide packets (Float8.hpp) that only use AVX2 when the compiler may emit it.
+    # The executable is run where it is built, so enable it whenever this machine has it.
+    if platform.machine()=="x86_64" and os.path.exists("/proc/cpuinfo") and " avx2" in open("/proc/cpuinfo").read():
+        ARGUMENTS+=" -mavx2"
 elif platform.system()=="Darwin":
     ARGUMENTS="-D MAC" # -D is a #define sent to the preprocessor.
     INCLUDE_DIR="-I ./include/ -I/Library/Frameworks/SDL2.framework/Headers -I./../../common/thirdparty/old/glm"
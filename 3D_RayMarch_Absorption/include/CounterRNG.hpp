@@ -0,0 +1,75 @@
+#include <cstdint>
+
+#ifndef COUNTER_RNG_HPP
+#define COUNTER_RNG_HPP
+
+// Independent random streams - each stochastic effect gets its own so adding one never shifts the others
+enum RNGStream : uint32_t {
+    RNG_STREAM_SPAWN_VELOCITY = 0,
+    RNG_STREAM_SPLASH = 1
+};
+
+// Counter-based random number generator (Philox4x32-10)
+// --> There is no internal state: the output is a pure function of (seed, particleID, frame, stream)
+// --> Any worker thread can draw numbers for any particle without locks, in any order
+// --> The same seed always reproduces the same run, no matter how work is split across threads
+class CounterRNG {
+public:
+    CounterRNG() : key0(0x5EEDu), key1(0u) {}
+    CounterRNG(uint64_t seed) : key0(static_cast<uint32_t>(seed)), key1(static_cast<uint32_t>(seed >> 32)) {}
+
+    // Four random 32-bit words for one (particle, frame, stream) counter
+    void generate(uint32_t particleID, uint32_t frame, uint32_t stream, uint32_t out[4]) const {
+        uint32_t c0 = particleID, c1 = frame, c2 = stream, c3 = 0u;
+        uint32_t k0 = key0, k1 = key1;
+
+        for (int round = 0; round < 10; round++) {
+            uint64_t p0 = static_cast<uint64_t>(PHILOX_M0) * c0;
+            uint64_t p1 = static_cast<uint64_t>(PHILOX_M1) * c2;
+            uint32_t hi0 = static_cast<uint32_t>(p0 >> 32), lo0 = static_cast<uint32_t>(p0);
+            uint32_t hi1 = static_cast<uint32_t>(p1 >> 32), lo1 = static_cast<uint32_t>(p1);
+
+            c0 = hi1 ^ c1 ^ k0;
+            c1 = lo1;
+            c2 = hi0 ^ c3 ^ k1;
+            c3 = lo0;
+
+            k0 += PHILOX_W0;
+            k1 += PHILOX_W1;
+        }
+
+        out[0] = c0; out[1] = c1; out[2] = c2; out[3] = c3;
+    }
+
+    // Uniform float in [0, 1) - lane picks one of the four words of the counter's output
+    float uniform(uint32_t particleID, uint32_t frame, uint32_t stream, int lane) const {
+        uint32_t words[4];
+        generate(particleID, frame, stream, words);
+        return toUnitFloat(words[lane & 3]);
+    }
+
+    // Four uniform floats in [0, 1) from a single Philox evaluation
+    void uniform4(uint32_t particleID, uint32_t frame, uint32_t stream, float out[4]) const {
+        uint32_t words[4];
+        generate(particleID, frame, stream, words);
+        for (int i = 0; i < 4; i++) {
+            out[i] = toUnitFloat(words[i]);
+        }
+    }
+
+private:
+    uint32_t key0;
+    uint32_t key1;
+
+    static constexpr uint32_t PHILOX_M0 = 0xD2511F53u;
+    static constexpr uint32_t PHILOX_M1 = 0xCD9E8D57u;
+    static constexpr uint32_t PHILOX_W0 = 0x9E3779B9u; // golden ratio
+    static constexpr uint32_t PHILOX_W1 = 0xBB67AE85u; // sqrt(3) - 1
+
+    // Top 24 bits -> exactly representable float in [0, 1)
+    static float toUnitFloat(uint32_t x) {
+        return static_cast<float>(x >> 8) * (1.0f / 16777216.0f);
+    }
+};
+
+#endif
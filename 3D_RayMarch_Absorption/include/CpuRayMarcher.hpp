@@ -0,0 +1,90 @@
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <vector>
+#include <string>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+
+#include "ParticleSnapshot.hpp"
+#include "ParticleGrid.hpp"
+#include "ParticleVolume.hpp"
+#include "LightTransmittance.hpp"
+#include "TileCuller.hpp"
+#include "Float8.hpp"
+#include "ImageWriter.hpp"
+
+#ifndef CPU_RAY_MARCHER_HPP
+#define CPU_RAY_MARCHER_HPP
+
+// CPU port of fragRayMarch.glsl (per-particle path, without the baked volume or temporal reprojection) - needs no GL context
+// --> Same smooth-min sphere SDF, analytic normals, diffuse + ambient shading and Beer-Lambert absorption, with the
+//     same constants, so its images are a reference to check shader changes against - the light is not shadowed
+//     (no LightTransmittance), so compare against the shader with Renderer::setLightShadows(false)
+// --> Built on the same ParticleGrid and TileCuller as the GPU path; TILE_SIZE x TILE_SIZE screen tiles are handed
+//     out to the worker threads one at a time
+// --> Each tile row is marched as packets of 8 rays (Float8): every particle a packet visits is fetched once for all 8 lanes
+// --> Like the shader, each packet visits whichever is shorter: its tile's list, or the grid cells around its lanes
+// --> Incremental mode keeps each tile's pixels until something that can change them does: the camera, or a particle in
+//     the tile's list appearing, leaving or moving further than the move tolerance since the tile was last marched
+class CpuRayMarcher{
+public:
+    CpuRayMarcher();
+
+    void setResolution(int i_width, int i_height);
+    void setIncremental(bool enabled); // only re-march tiles whose particles moved (see setMoveTolerance())
+    void setMoveTolerance(float distance); // world units a particle may drift before the tiles it reaches are re-marched
+    void Render(ParticleSpan<glm::vec3> positions, ParticleSpan<float> radii, ParticleSpan<uint8_t> flags,
+                const glm::mat4& view, const glm::vec3& viewPosition, const glm::vec3& lightPosition);
+
+    const std::vector<unsigned char>& getPixels(); // RGBA8, bottom row first like glReadPixels - alpha 0 where the rays missed
+    void SaveFrame(const std::string& path); // binary PPM
+    int getMarchedTileCount(); // tiles the last Render() re-marched (all non-empty tiles unless incremental)
+
+private:
+    static constexpr int TILE_SIZE = TileCuller::TILE_SIZE;
+    static constexpr int MAX_STEPS = 100; // per march, as in the shader
+
+    int numThreads;
+    int width;
+    int height;
+    glm::mat4 projection; // same perspective as Renderer, for the tile culling
+    float blendFactor; // same as Renderer
+
+    ParticleGrid particleGrid;
+    TileCuller tileCuller;
+    std::vector<unsigned char> pixels;
+
+    // Incremental re-rendering: what every tile was last marched with
+    // --> sources = solver indices (stable across frames, unlike grid order), particles = position + radius at that time
+    struct TileHistory{
+        std::vector<int> sources;
+        std::vector<glm::vec4> particles;
+    };
+    bool incremental;
+    float moveTolerance;
+    bool historyValid; // tileHistory and pixels belong to the current camera, light and resolution
+    glm::mat4 historyView;
+    glm::vec3 historyLightPosition;
+    std::vector<TileHistory> tileHistory;
+    std::atomic<int> marchedTiles;
+
+    // Per-frame state shared by the worker threads
+    glm::vec3 rayOrigin;
+    glm::mat3 cameraRotation;
+    glm::vec3 lightPosition;
+    glm::vec3 fluidBoundsMin;
+    glm::vec3 fluidBoundsMax;
+    std::atomic<int> nextTile;
+
+    void RenderTilesThread();
+    void RenderTile(int tileIndex);
+    bool UpdateTileHistory(int tileIndex, int tileFirst, int tileLast); // true if the tile has to be marched again
+    void RenderPacket(int x, int y, int laneCount, int tileFirst, int tileLast);
+
+    // Distance (and gradient if gradient != nullptr) of the particle surface at the lanes in laneMask - evaluateParticles()
+    Float8 EvaluatePacket(const Float8 pos[3], int laneMask, int tileFirst, int tileLast, Float8* gradient);
+};
+
+#endif
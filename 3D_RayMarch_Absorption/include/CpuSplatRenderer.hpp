@@ -0,0 +1,68 @@
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <vector>
+#include <string>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+
+#include "ParticleSnapshot.hpp"
+#include "TileCuller.hpp"
+#include "Float8.hpp"
+#include "ImageWriter.hpp"
+
+#ifndef CPU_SPLAT_RENDERER_HPP
+#define CPU_SPLAT_RENDERER_HPP
+
+// Quick CPU preview: every particle is splatted as a depth-tested, shaded disc - needs no GL context
+// --> Same view (Camera::GetViewMatrix()) and perspective as Renderer, same lighting as the sphere impostors
+//     (ambient + diffuse + specular, particle mesh blue); the disc's depth and normal are those of the sphere's front
+// --> Particles are binned into screen tiles by TileCuller; worker threads take one tile at a time and rasterize
+//     into a tile-local depth and color buffer, eight pixels of a row at a time (Float8)
+// --> Cost is one projection per particle plus the pixels it covers, so it scales to millions of particles
+class CpuSplatRenderer{
+public:
+    CpuSplatRenderer();
+
+    void setResolution(int i_width, int i_height);
+    void Render(ParticleSpan<glm::vec3> positions, ParticleSpan<float> radii, ParticleSpan<uint8_t> flags,
+                const glm::mat4& view, const glm::vec3& lightPosition);
+
+    const std::vector<unsigned char>& getPixels(); // RGBA8, bottom row first like glReadPixels - alpha 0 where no disc was drawn
+    void SaveFrame(const std::string& path); // binary PPM
+
+private:
+    static constexpr int TILE_SIZE = TileCuller::TILE_SIZE;
+    static constexpr int TILE_ROW_PACKETS = TILE_SIZE / Float8::LANES;
+
+    // One particle projected to the screen
+    struct Splat{
+        glm::vec2 center; // pixels, from the bottom left
+        float radius; // pixels, 0 if the particle cannot be seen
+        float depth; // distance in front of the camera to the sphere's center
+        float worldRadius;
+        glm::vec3 lightDir; // view space, from the center towards the light
+    };
+
+    int numThreads;
+    int width;
+    int height;
+    glm::mat4 projection; // same perspective as Renderer
+
+    std::vector<glm::vec4> particles; // active particles: xyz = position, w = radius
+    std::vector<Splat> splats; // same order as particles
+    TileCuller tileCuller;
+    std::vector<unsigned char> pixels;
+
+    // Per-frame state shared by the worker threads
+    glm::mat4 view;
+    glm::vec3 lightPosition;
+    std::atomic<int> nextTile;
+
+    void ProjectThread(int startIdx, int endIdx);
+    void RenderTilesThread();
+    void RenderTile(int tileIndex);
+};
+
+#endif
@@ -0,0 +1,80 @@
+#include <cmath>
+#include <algorithm>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+#ifndef FLOAT8_HPP
+#define FLOAT8_HPP
+
+// Eight floats processed in lock step - one lane per ray (or pixel) of a packet
+// --> Built with AVX2 enabled (-mavx2 or -march=native; build.py adds -mavx2 on x86-64 Linux machines that have it)
+//     every operation is a single 256-bit instruction
+// --> Otherwise the same operations are plain loops over eight floats, so results match lane for lane
+// --> Comparisons return a lane bit mask (bit i = lane i), which is also how callers track live lanes
+struct Float8 {
+    static constexpr int LANES = 8;
+    static constexpr int ALL_LANES = 0xFF;
+
+#if defined(__AVX2__)
+    __m256 v;
+
+    Float8() : v(_mm256_setzero_ps()) {}
+    Float8(float s) : v(_mm256_set1_ps(s)) {}
+    Float8(__m256 i_v) : v(i_v) {}
+
+    static Float8 Load(const float* p) { return Float8(_mm256_loadu_ps(p)); }
+    void Store(float* p) const { _mm256_storeu_ps(p, v); }
+
+    friend Float8 operator+(Float8 a, Float8 b) { return Float8(_mm256_add_ps(a.v, b.v)); }
+    friend Float8 operator-(Float8 a, Float8 b) { return Float8(_mm256_sub_ps(a.v, b.v)); }
+    friend Float8 operator*(Float8 a, Float8 b) { return Float8(_mm256_mul_ps(a.v, b.v)); }
+    friend Float8 operator/(Float8 a, Float8 b) { return Float8(_mm256_div_ps(a.v, b.v)); }
+    friend Float8 min(Float8 a, Float8 b) { return Float8(_mm256_min_ps(a.v, b.v)); }
+    friend Float8 max(Float8 a, Float8 b) { return Float8(_mm256_max_ps(a.v, b.v)); }
+    friend Float8 sqrt(Float8 a) { return Float8(_mm256_sqrt_ps(a.v)); }
+
+    friend int operator<(Float8 a, Float8 b) { return _mm256_movemask_ps(_mm256_cmp_ps(a.v, b.v, _CMP_LT_OQ)); }
+    friend int operator>(Float8 a, Float8 b) { return _mm256_movemask_ps(_mm256_cmp_ps(a.v, b.v, _CMP_GT_OQ)); }
+
+    // Lanes in mask take a, the others b
+    static Float8 Select(int mask, Float8 a, Float8 b) {
+        const __m256i laneBits = _mm256_setr_epi32(1, 2, 4, 8, 16, 32, 64, 128);
+        __m256i selected = _mm256_and_si256(_mm256_set1_epi32(mask), laneBits);
+        __m256 laneMask = _mm256_castsi256_ps(_mm256_cmpeq_epi32(selected, laneBits));
+        return Float8(_mm256_blendv_ps(b.v, a.v, laneMask));
+    }
+
+    float operator[](int i) const { alignas(32) float lanes[LANES]; _mm256_store_ps(lanes, v); return lanes[i]; }
+#else
+    float v[LANES];
+
+    Float8() { for (int i = 0; i < LANES; i++) v[i] = 0.0f; }
+    Float8(float s) { for (int i = 0; i < LANES; i++) v[i] = s; }
+
+    static Float8 Load(const float* p) { Float8 r; for (int i = 0; i < LANES; i++) r.v[i] = p[i]; return r; }
+    void Store(float* p) const { for (int i = 0; i < LANES; i++) p[i] = v[i]; }
+
+    friend Float8 operator+(Float8 a, Float8 b) { for (int i = 0; i < LANES; i++) a.v[i] += b.v[i]; return a; }
+    friend Float8 operator-(Float8 a, Float8 b) { for (int i = 0; i < LANES; i++) a.v[i] -= b.v[i]; return a; }
+    friend Float8 operator*(Float8 a, Float8 b) { for (int i = 0; i < LANES; i++) a.v[i] *= b.v[i]; return a; }
+    friend Float8 operator/(Float8 a, Float8 b) { for (int i = 0; i < LANES; i++) a.v[i] /= b.v[i]; return a; }
+    friend Float8 min(Float8 a, Float8 b) { for (int i = 0; i < LANES; i++) a.v[i] = b.v[i] < a.v[i] ? b.v[i] : a.v[i]; return a; }
+    friend Float8 max(Float8 a, Float8 b) { for (int i = 0; i < LANES; i++) a.v[i] = b.v[i] > a.v[i] ? b.v[i] : a.v[i]; return a; }
+    friend Float8 sqrt(Float8 a) { for (int i = 0; i < LANES; i++) a.v[i] = std::sqrt(a.v[i]); return a; }
+
+    friend int operator<(Float8 a, Float8 b) { int m = 0; for (int i = 0; i < LANES; i++) m |= (a.v[i] < b.v[i]) << i; return m; }
+    friend int operator>(Float8 a, Float8 b) { int m = 0; for (int i = 0; i < LANES; i++) m |= (a.v[i] > b.v[i]) << i; return m; }
+
+    // Lanes in mask take a, the others b
+    static Float8 Select(int mask, Float8 a, Float8 b) { for (int i = 0; i < LANES; i++) if (mask & (1 << i)) b.v[i] = a.v[i]; return b; }
+
+    float operator[](int i) const { return v[i]; }
+#endif
+
+    friend Float8 clamp(Float8 a, Float8 lo, Float8 hi) { return min(max(a, lo), hi); }
+    friend Float8 mix(Float8 a, Float8 b, Float8 t) { return a + (b - a) * t; }
+};
+
+#endif
@@ -0,0 +1,24 @@
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+
+#ifndef HASH_HPP
+#define HASH_HPP
+
+// 64-bit FNV-1a over 8-byte words, then the tail byte by byte - keys the .mesh and shader caches
+// --> Hashed on every start, so it must keep up with the disk; not meant to resist deliberate collisions
+inline uint64_t HashBytes(const char* data, size_t size){
+    uint64_t hash = 14695981039346656037ull;
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8) {
+        uint64_t word;
+        memcpy(&word, data + i, 8);
+        hash = (hash ^ word) * 1099511628211ull;
+    }
+    for (; i < size; i++) {
+        hash = (hash ^ (uint8_t)data[i]) * 1099511628211ull;
+    }
+    return hash;
+}
+
+#endif
@@ -0,0 +1,51 @@
+#include <glad/glad.h>
+#ifdef LINUX
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "ImageWriter.hpp"
+
+#ifndef HEADLESS_CONTEXT_HPP
+#define HEADLESS_CONTEXT_HPP
+
+#ifdef LINUX
+
+// OpenGL 4.1 core context without a window, for batch renders on machines with no display (EGL, Linux only)
+// --> Tries a surfaceless Mesa display first, then the default display with a small pbuffer surface
+// --> Mesa falls back to llvmpipe when no GPU is present, so the same Renderer pipelines run in software
+// --> Frames are drawn into an offscreen framebuffer (RGBA8 color + 24 bit depth) instead of a window
+class HeadlessContext{
+public:
+    HeadlessContext();
+
+    void Initialize(int i_width, int i_height); // creates the context, loads GL through glad and builds the framebuffer
+    void CleanUp();
+
+    void Bind(); // render into the offscreen framebuffer - call before each RenderScene*()
+    void SaveFrame(const std::string& path); // read the framebuffer back and write it as a binary PPM
+
+private:
+    int width;
+    int height;
+
+    EGLDisplay display;
+    EGLContext context;
+    EGLSurface surface; // EGL_NO_SURFACE on the surfaceless platform
+
+    GLuint framebuffer;
+    GLuint colorRenderbuffer;
+    GLuint depthRenderbuffer;
+
+    std::vector<unsigned char> pixels; // RGBA readback, bottom row first
+
+    bool CreateDisplay();
+};
+
+#endif
+
+#endif
@@ -0,0 +1,33 @@
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#ifndef IMAGE_WRITER_HPP
+#define IMAGE_WRITER_HPP
+
+// Writes an RGBA8 image as a binary PPM (alpha is dropped)
+// --> rgba rows are bottom first, as glReadPixels returns them and as the CPU renderers fill them
+inline bool WritePPM(const std::string& path, int width, int height, const unsigned char* rgba){
+    std::ofstream file(path, std::ios::binary);
+    if (!file) {
+        std::cout << "Could not write frame: " << path << "\n";
+        return false;
+    }
+    file << "P6\n" << width << " " << height << "\n255\n";
+
+    // PPM rows start at the top
+    std::vector<unsigned char> row((size_t)width * 3);
+    for (int y = height - 1; y >= 0; y--) {
+        const unsigned char* source = rgba + (size_t)y * width * 4;
+        for (int x = 0; x < width; x++) {
+            row[x * 3 + 0] = source[x * 4 + 0];
+            row[x * 3 + 1] = source[x * 4 + 1];
+            row[x * 3 + 2] = source[x * 4 + 2];
+        }
+        file.write((const char*)row.data(), row.size());
+    }
+    return true;
+}
+
+#endif
@@ -0,0 +1,50 @@
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <thread>
+#include <cmath>
+#include <algorithm>
+
+#include "ParticleVolume.hpp"
+
+#ifndef LIGHT_TRANSMITTANCE_HPP
+#define LIGHT_TRANSMITTANCE_HPP
+
+// Deep shadow grid: how much of the scene light still reaches each point after passing through the fluid
+// --> Built on the CPU every frame from ParticleVolume's density, at half its resolution, by marching from every
+//     voxel towards the light (z slabs in parallel); uploaded as a 3D texture so shading a hit costs one fetch
+// --> Same Beer-Lambert scale as accumulateDensity() in fragRayMarch.glsl: optical depth is ABSORPTION / DENSITY_STEP
+//     times the integral of the density along the ray, and the density is the volume's max(DENSITY_BAND - distance, 0)
+//     on the blended surface - what mapDensity() computes analytically
+// --> Marches start DENSITY_BAND towards the light, so a lit surface is not shadowed by its own density falloff
+class LightTransmittance{
+public:
+    LightTransmittance();
+
+    void Build(ParticleVolume& volume, const glm::vec3& lightPosition); // volume must already be built for this frame
+
+    const std::vector<float>& getTransmittance(); // x fastest, then y, then z - 1 = fully lit
+    glm::ivec3 getDims();
+    glm::vec3 getOrigin(); // center of voxel (0, 0, 0)
+    float getVoxelSize();
+
+    static constexpr int DOWNSAMPLE = 2; // density voxels per transmittance voxel along each axis
+    static constexpr float ABSORPTION = 0.1f; // ABSORPTION in fragRayMarch.glsl, defined from here by the Renderer
+    static constexpr float DENSITY_STEP = 0.1f; // the step fragRayMarch.glsl weighs its density samples to (DENSITY_SAMPLE_WEIGHT)
+
+private:
+    int numThreads;
+
+    ParticleVolume* volume; // only valid during Build()
+    glm::vec3 lightPosition;
+
+    std::vector<float> transmittance;
+    glm::ivec3 dims;
+    glm::vec3 origin;
+    float voxelSize;
+
+    float SampleDensity(const glm::vec3& pos); // trilinear, like the GPU's filtered fetch
+    void MarchSlabThread(int zStart, int zEnd);
+};
+
+#endif
@@ -0,0 +1,47 @@
+#include <SDL2/SDL.h>
+
+#include <fstream>
+#include <string>
+#include <vector>
+#include <cstddef>
+#include <cstdio>
+#include <initializer_list>
+
+#ifndef MAPPED_FILE_HPP
+#define MAPPED_FILE_HPP
+
+// Read-only view of a whole file - mapped with mmap where the platform has it, read into memory otherwise
+class MappedFile{
+public:
+    MappedFile();
+    ~MappedFile();
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool Open(const std::string& path);
+    void Close();
+    const char* getData();
+    size_t getSize();
+
+private:
+    const char* data;
+    size_t size;
+    bool mapped;
+    std::vector<char> buffer; // only used without mmap
+};
+
+// One piece of a file written by WriteFileAtomic()
+struct FileChunk{
+    const void* data;
+    size_t size;
+};
+
+// Writes the chunks back to back to path + ".tmp" and renames that over path, so a concurrent reader (another launch
+// opening the same cache) sees either the old file or the complete new one; false and no file left behind on failure
+bool WriteFileAtomic(const std::string& path, std::initializer_list<FileChunk> chunks);
+
+// Directory of the executable with a trailing separator, resolved once; the working directory ("./") when SDL can't
+// tell on this platform
+const std::string& BasePath();
+
+#endif
@@ -0,0 +1,42 @@
+#include <glm/glm.hpp>
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <cstdio>
+
+#include "MappedFile.hpp"
+#include "Hash.hpp"
+
+#ifndef MESH_LOADER_HPP
+#define MESH_LOADER_HPP
+
+// Indexed triangle mesh with one normal per vertex, ready to be uploaded as is
+struct MeshData{
+    std::vector<glm::vec3> positions;
+    std::vector<glm::vec3> normals;
+    std::vector<uint32_t> indices; // three per triangle, in the OBJ's winding
+};
+
+// Loads a Wavefront OBJ through a binary cache next to it (model.obj -> model.mesh)
+// --> The cache holds the finished mesh, tagged with a hash of the OBJ's bytes; when the hash still matches, loading
+//     is one mmap and two copies, otherwise the OBJ is parsed and the cache rewritten
+// --> OBJ parsing walks the mapped bytes directly - no per-line or per-token strings; v, vn and f lines are read
+//     (any of the v, v/vt, v//vn, v/vt/vn corner forms, negative indices, polygons fanned into triangles), the rest is
+//     skipped; each distinct position/normal pair becomes one vertex, and corners without a normal get the
+//     area-weighted average of their faces' normals
+// --> Triangles are reordered for the post-transform vertex cache (Forsyth's linear-speed method), then vertices are
+//     renumbered in the order the triangles first use them, so vertex fetches also walk the buffer forward
+bool LoadMesh(const std::string& objPath, MeshData& mesh);
+
+bool ParseOBJ(const char* begin, const char* end, MeshData& mesh);
+void OptimizeVertexCache(MeshData& mesh);
+float AverageCacheMissRatio(const std::vector<uint32_t>& indices, int cacheSize); // vertex shader runs per triangle, FIFO cache
+
+#endif
@@ -0,0 +1,84 @@
+#include <glm/glm.hpp>
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+#ifndef MESH_WRITER_HPP
+#define MESH_WRITER_HPP
+
+// Writes an indexed triangle mesh with per-vertex normals as a binary little-endian PLY
+inline bool WritePLY(const std::string& path, const std::vector<glm::vec3>& positions, const std::vector<glm::vec3>& normals,
+                     const std::vector<uint32_t>& indices){
+    std::ofstream file(path, std::ios::binary);
+    if (!file) {
+        std::cout << "Could not write mesh: " << path << "\n";
+        return false;
+    }
+    file << "ply\nformat binary_little_endian 1.0\n"
+         << "element vertex " << positions.size() << "\n"
+         << "property float x\nproperty float y\nproperty float z\n"
+         << "property float nx\nproperty float ny\nproperty float nz\n"
+         << "element face " << indices.size() / 3 << "\n"
+         << "property list uchar uint vertex_indices\n"
+         << "end_header\n";
+
+    // Vertices and faces are staged in one buffer each, so the file sees a few large writes
+    std::vector<float> vertexData(positions.size() * 6);
+    for (size_t i = 0; i < positions.size(); i++) {
+        float* vertex = &vertexData[i * 6];
+        vertex[0] = positions[i].x;
+        vertex[1] = positions[i].y;
+        vertex[2] = positions[i].z;
+        vertex[3] = normals[i].x;
+        vertex[4] = normals[i].y;
+        vertex[5] = normals[i].z;
+    }
+    file.write((const char*)vertexData.data(), vertexData.size() * sizeof(float));
+
+    const size_t faceBytes = 1 + 3 * sizeof(uint32_t);
+    std::vector<char> faceData(indices.size() / 3 * faceBytes);
+    for (size_t i = 0; i < indices.size() / 3; i++) {
+        char* face = &faceData[i * faceBytes];
+        face[0] = 3;
+        memcpy(face + 1, &indices[i * 3], 3 * sizeof(uint32_t));
+    }
+    file.write(faceData.data(), faceData.size());
+    return true;
+}
+
+// Writes the same mesh as a Wavefront OBJ (text - OBJ has no binary form), indices are 1-based
+inline bool WriteOBJ(const std::string& path, const std::vector<glm::vec3>& positions, const std::vector<glm::vec3>& normals,
+                     const std::vector<uint32_t>& indices){
+    std::ofstream file(path);
+    if (!file) {
+        std::cout << "Could not write mesh: " << path << "\n";
+        return false;
+    }
+
+    // Formatted into one buffer rather than through the stream's per-value formatting
+    std::string text;
+    text.reserve(positions.size() * 80 + indices.size() * 12);
+    char line[128];
+    for (const glm::vec3& p : positions) {
+        int length = snprintf(line, sizeof(line), "v %.6g %.6g %.6g\n", p.x, p.y, p.z);
+        text.append(line, length);
+    }
+    for (const glm::vec3& n : normals) {
+        int length = snprintf(line, sizeof(line), "vn %.4f %.4f %.4f\n", n.x, n.y, n.z);
+        text.append(line, length);
+    }
+    for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+        uint32_t a = indices[i] + 1, b = indices[i + 1] + 1, c = indices[i + 2] + 1;
+        int length = snprintf(line, sizeof(line), "f %u//%u %u//%u %u//%u\n", a, a, b, b, c, c);
+        text.append(line, length);
+    }
+    file.write(text.data(), text.size());
+    return true;
+}
+
+#endif
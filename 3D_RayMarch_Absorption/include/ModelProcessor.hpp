@@ -5,9 +5,6 @@
 #include <glm/mat4x4.hpp>
 #include <glm/gtc/matrix_transform.hpp> 
 
-#include <cstdlib>  // for rand, srand
-#include <ctime>    // for time
-
 #ifndef MODEL_PROCESSOR_HPP
 #define MODEL_PROCESSOR_HPP
 
@@ -15,28 +12,31 @@
 #include <iostream>
 #include <vector>
 #include <string>
-#include <sstream>
-#include <fstream>
 #include <unordered_map>
+#include <chrono>
 
 // Our libraries
-#include "Vertex.hpp"
-#include "Triangle.hpp"
+#include "MeshLoader.hpp"
+
+// GL handles of one uploaded model, copied out once so draws need no map lookups
+struct MeshHandles{
+    GLuint vertexArrayObject = 0;
+    GLuint vertexBufferObject = 0;
+    GLuint indexBufferObject = 0;
+    int totalIndices = 0;
+};
 
 class ModelProcessor{
 public:
     ModelProcessor();
 
-    void VertexSpecification(int gSolverGetParticlesSize);
-    void CleanUp(int gSolverGetParticlesSize);
-    int getObjTotalIndices(std::string objName);
+    void VertexSpecification(); // one shared mesh per object - particles are drawn instanced from the "Particle" mesh
+    void CleanUp();
+    MeshHandles getMesh(const std::string& objName); // after VertexSpecification()
 
-    std::unordered_map<std::string, std::vector<GLuint>> getGVertexArrayObjects_map();
-    std::unordered_map<std::string, std::vector<GLuint>> getGVertexBufferObjects_map();
+    static std::string ModelPath(const std::string& fileName); // src/models/ next to the executable
 
 private:
-    std::ofstream outFile;
-
     // Map that stores bufers for each object in the scene
     std::unordered_map<std::string, std::vector<GLuint>> gVertexArrayObjects_map; 
     std::unordered_map<std::string, std::vector<GLuint>> gVertexBufferObjects_map;
@@ -46,18 +46,11 @@ private:
     void GenerateModelBufferData(int numObjects, std::string particleObjFilepath, std::string objName); // (1)
     void GenerateModelBlueprint(std::string particleObjFilepath, std::string objName); // (2)
     void PrepareAndSendRenderDataToBuffers(int numObjects, std::string objName); // (3)
-    void GenerateModelData(std::string modelObjFilepath, std::string objName); // (2) (a)
-    void ParseModelData(std::string filepath, std::string objName);
-    void getModelMesh(std::string objName);
-    std::vector<GLfloat> getVerticesAndAddColorData(std::string objName, glm::vec3 color);
-    void offsetGModelIndices(std::string objName); // (2) (b)
+    void GenerateModelData(std::string modelObjFilepath); // (2) (a)
+    std::vector<GLfloat> getVerticesAndAddColorData(const MeshData& mesh, glm::vec3 color);
     void ConfigureVertexAttributes(std::string objName); // (3) (a)
 
-    std::unordered_map<std::string, std::vector<Vertex>> gModelVertices_map;
-    std::unordered_map<std::string, std::vector<Vertex>> gModelNormals_map;
-    std::unordered_map<std::string, std::vector<int>> gModelIndices_map;
-    std::unordered_map<std::string,  std::unordered_map<int, int>> gModelNormalsMap_map;
-    std::unordered_map<std::string,  std::vector<Triangle>> gMesh_map;
+    std::unordered_map<std::string, MeshData> gModelMeshes_map; // by OBJ path, so objects sharing a model load it once
     std::unordered_map<std::string,  size_t> gTotalIndices_map;
     std::unordered_map<std::string,  std::string> modelObjFilepath_map;
 };
@@ -0,0 +1,59 @@
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <thread>
+#include <algorithm>
+
+#include "ParticleSnapshot.hpp"
+
+#ifndef PARTICLE_GRID_HPP
+#define PARTICLE_GRID_HPP
+
+// Uniform cell grid over the active particles, rebuilt on the CPU every frame for the ray-march shader
+// --> Particles are counting-sorted by cell, so each cell's particles are contiguous in getSortedParticles()
+// --> getCellStarts()[c] .. getCellStarts()[c + 1] is the range of particles in cell c
+// --> The cell size is the blend radius (2 * max radius + blend factor): any particle outside the 3x3x3 cells
+//     around a sample point is too far away to change the smooth-min surface there
+class ParticleGrid{
+public:
+    ParticleGrid();
+
+    void Build(ParticleSpan<glm::vec3> positions, ParticleSpan<float> radii, ParticleSpan<uint8_t> flags, float blendFactor);
+
+    const std::vector<glm::vec4>& getSortedParticles(); // xyz = position, w = radius
+    const std::vector<int>& getSortedSource(); // index into the Build() arrays of every sorted particle
+    const std::vector<int>& getCellStarts(); // numCells + 1 offsets into getSortedParticles()
+    int getParticleCount();
+    glm::vec3 getOrigin();
+    glm::ivec3 getDims();
+    float getCellSize();
+    float getMaxRadius();
+    float getBlendFactor(); // blend factor of the last Build()
+    glm::vec3 getBoundsMin(); // tight bounds of the active particles (centers only)
+    glm::vec3 getBoundsMax();
+
+private:
+    static constexpr int MAX_CELLS = 1 << 20; // grid grows its cells rather than exceed this many
+
+    int numThreads;
+
+    std::vector<glm::vec4> compacted; // active particles in solver order
+    std::vector<int> compactedSource;
+    std::vector<int> cellOfParticle;
+    std::vector<glm::vec4> sortedParticles;
+    std::vector<int> sortedSource;
+    std::vector<int> cellStarts;
+    std::vector<int> cellCursor;
+
+    glm::vec3 origin;
+    glm::ivec3 dims;
+    float cellSize;
+    float maxRadius;
+    float blendFactor;
+    glm::vec3 boundsMin;
+    glm::vec3 boundsMax;
+
+    void ComputeCellsThread(int startIdx, int endIdx);
+};
+
+#endif
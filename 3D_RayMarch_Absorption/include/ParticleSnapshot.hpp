@@ -0,0 +1,89 @@
+#include <glm/glm.hpp>
+#include <glm/mat4x4.hpp>
+
+#include <vector>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstddef>
+
+#ifndef PARTICLE_SNAPSHOT_HPP
+#define PARTICLE_SNAPSHOT_HPP
+
+// Per-particle flag bits in ParticleSnapshot::flags
+enum ParticleFlag : uint8_t {
+    PARTICLE_FLAG_ACTIVE = 1 << 0
+};
+
+// Read-only view of a contiguous array - lets readers walk snapshot data without copying it
+template <typename T>
+class ParticleSpan {
+public:
+    ParticleSpan() : ptr(nullptr), count(0) {}
+    ParticleSpan(const T* i_ptr, size_t i_count) : ptr(i_ptr), count(i_count) {}
+    ParticleSpan(const std::vector<T>& v) : ptr(v.data()), count(v.size()) {}
+
+    const T* data() const { return ptr; }
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+    const T& operator[](size_t i) const { return ptr[i]; }
+    const T* begin() const { return ptr; }
+    const T* end() const { return ptr + count; }
+
+private:
+    const T* ptr;
+    size_t count;
+};
+
+// Immutable copy of the simulation state at the end of one completed solver frame
+// Stored as structure-of-arrays so renderers, exporters and analysis can stream each attribute at memory bandwidth
+struct ParticleSnapshot {
+    uint64_t frame = 0; // solver frame this snapshot was taken after - doubles as the snapshot version
+    std::vector<glm::vec3> positions;
+    std::vector<glm::vec3> previousPositions; // positions one solver frame earlier, for render interpolation
+    std::vector<float> radii;
+    std::vector<uint8_t> flags; // ParticleFlag bits
+    glm::mat4 boxTransform = glm::mat4(1.0f);
+
+    float stepDt = 0.0f; // simulated time between previousPositions and positions
+    std::chrono::steady_clock::time_point stepTime; // wall-clock time at which this frame was due
+
+    uint64_t layoutVersion = 0; // solver particle layout the radii were copied from (see Solver::writeSnapshot)
+
+    uint64_t getFrame() const { return frame; }
+    size_t getParticleCount() const { return positions.size(); }
+    ParticleSpan<glm::vec3> getPositions() const { return ParticleSpan<glm::vec3>(positions); }
+    ParticleSpan<glm::vec3> getPreviousPositions() const { return ParticleSpan<glm::vec3>(previousPositions); }
+    ParticleSpan<float> getRadii() const { return ParticleSpan<float>(radii); }
+    ParticleSpan<uint8_t> getFlags() const { return ParticleSpan<uint8_t>(flags); }
+    bool isActive(size_t i) const { return (flags[i] & PARTICLE_FLAG_ACTIVE) != 0; }
+};
+
+// Lock-free triple buffer between the simulation thread (single writer) and the render thread (single reader)
+// --> The writer always has a private slot to fill, so it never waits on the renderer
+// --> The reader always holds a complete snapshot, so it never waits on the solver
+// --> The third slot is the hand-off: the most recently published snapshot
+class SnapshotBuffer {
+public:
+    SnapshotBuffer();
+
+    // Writer side
+    ParticleSnapshot& beginWrite(); // slot owned by the writer until publish()
+    void publish(); // hand the written slot to the reader
+
+    // Reader side
+    const ParticleSnapshot& acquireLatest(); // stays valid until the next acquireLatest()
+
+    SnapshotBuffer(const SnapshotBuffer&) = delete;
+    SnapshotBuffer& operator=(const SnapshotBuffer&) = delete;
+
+private:
+    static constexpr int FRESH_BIT = 4; // set on the shared index when it holds an unread snapshot
+
+    ParticleSnapshot slots[3];
+    int writeIndex;
+    int readIndex;
+    std::atomic<int> sharedIndex; // slot index | FRESH_BIT
+};
+
+#endif
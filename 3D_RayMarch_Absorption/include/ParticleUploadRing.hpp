@@ -0,0 +1,52 @@
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <iostream>
+
+#include "ParticleSnapshot.hpp"
+
+#ifndef PARTICLE_UPLOAD_RING_HPP
+#define PARTICLE_UPLOAD_RING_HPP
+
+// Streams per-frame particle data to the GPU through a ring of texture buffer objects (samplerBuffer in GLSL)
+// --> The same buffers can also be read as instanced vertex attributes (getCurrentBuffer())
+// --> Upload(): each texel is one particle (GL_RGBA32F, xyz = position, w = radius)
+// --> Only active particles are written, packed back to back, so the shader loops over exactly the live count
+// --> UploadTexels(): raw per-frame arrays in any texel format (e.g. GL_R32I cell offsets)
+// --> Three buffers rotate so the CPU writes one while the GPU may still be reading the other two;
+//     a fence per slot guarantees we never overwrite data a previous frame is still using
+class ParticleUploadRing{
+public:
+    ParticleUploadRing();
+
+    void Create(GLenum i_internalFormat = GL_RGBA32F, size_t i_texelSize = sizeof(glm::vec4)); // needs a current GL context
+    void CleanUp();
+
+    // Writes the active particles into the next slot, returns how many were written (GL_RGBA32F rings only)
+    int Upload(ParticleSpan<glm::vec3> positions, ParticleSpan<float> radii, ParticleSpan<uint8_t> flags);
+    // Copies count texels into the next slot, returns how many were written
+    int UploadTexels(const void* data, size_t count);
+    void Bind(GLuint textureUnit); // bind the slot written by the last Upload()
+    GLuint getCurrentBuffer(); // buffer of the slot written by the last Upload()
+    void FenceCurrentSlot(); // call after the draw calls that read the current slot
+
+    int getMaxParticles();
+
+private:
+    static constexpr int RING_SIZE = 3;
+
+    GLuint buffers[RING_SIZE];
+    GLuint textures[RING_SIZE];
+    GLsync fences[RING_SIZE];
+    size_t capacities[RING_SIZE]; // in texels
+    GLenum internalFormat;
+    size_t texelSize; // bytes
+    int currentSlot;
+    int maxTexels; // GL_MAX_TEXTURE_BUFFER_SIZE
+
+    void WaitForSlot(int slot);
+    void EnsureCapacity(int slot, size_t numTexels);
+    size_t BeginSlot(size_t numTexels); // advance + wait + grow, returns the texel count that fits
+};
+
+#endif
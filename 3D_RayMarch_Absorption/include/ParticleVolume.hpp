@@ -0,0 +1,51 @@
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <thread>
+#include <algorithm>
+
+#include "ParticleGrid.hpp"
+
+#ifndef PARTICLE_VOLUME_HPP
+#define PARTICLE_VOLUME_HPP
+
+// Voxel volume baked from the particles on the CPU every frame, uploaded as a 3D texture for the ray marcher
+// --> x = narrow-band signed distance (the same smooth-min surface map() evaluates), clamped to bandWidth
+// --> y = density: a linear falloff of x that reaches zero DENSITY_BAND past the surface (mapDensity() in the shader)
+// --> Particles are splatted into the voxels around them (z slabs in parallel), so baking costs O(particles)
+// --> With trilinear filtering one texture fetch replaces a whole neighbourhood of particles per march step
+class ParticleVolume{
+public:
+    ParticleVolume();
+
+    void setResolution(int i_resolution); // voxels along the longest axis of the particle bounds
+    int getResolution();
+
+    void Build(ParticleGrid& grid); // grid must already be built for this frame
+
+    const std::vector<glm::vec2>& getVoxels(); // x fastest, then y, then z
+    glm::ivec3 getDims();
+    glm::vec3 getOrigin(); // center of voxel (0, 0, 0)
+    float getVoxelSize();
+    float getBandWidth();
+
+    static constexpr float DENSITY_BAND = 0.2f; // how far past the surface density is still accumulated
+
+private:
+    int numThreads;
+    int resolution;
+
+    ParticleGrid* grid; // only valid during Build()
+
+    std::vector<glm::vec2> voxels;
+    glm::ivec3 dims;
+    glm::vec3 origin;
+    float voxelSize;
+    float bandWidth;
+
+    static constexpr float UNSET_DISTANCE = 1e30f; // voxel no particle has reached yet
+
+    void SplatSlabThread(int zStart, int zEnd);
+};
+
+#endif
@@ -15,6 +15,7 @@
 #include <sstream>
 #include <fstream>
 #include <unordered_map>
+#include <chrono>
 
 #include "Solver.hpp"
 #include "Particle.hpp"
@@ -23,20 +24,41 @@
 #include "Triangle.hpp"
 #include "Scene.hpp"
 #include "Container.hpp"
+#include "ParticleSnapshot.hpp"
+#include "ParticleUploadRing.hpp"
+#include "ParticleGrid.hpp"
+#include "ParticleVolume.hpp"
+#include "LightTransmittance.hpp"
+#include "TileCuller.hpp"
+#include "SurfaceExtractor.hpp"
+#include "ShaderCache.hpp"
 
 #ifndef RENDERER_HPP
 #define RENDERER_HPP
 
+// Ray-march quality levels - each is its own permutation of fragRayMarch.glsl (step counts compiled in as #defines),
+// all linked by CreateGraphicsPipelines() so switching between them never waits on the compiler
+enum RayMarchQuality { RAY_MARCH_QUALITY_LOW, RAY_MARCH_QUALITY_MEDIUM, RAY_MARCH_QUALITY_HIGH, RAY_MARCH_QUALITY_COUNT };
+
 class Renderer{
 public:
     Renderer();
     Renderer(int i_screenWidth, int i_screenHeight, Scene* scene);
 
     void updateZ(float val);
+    void setSnapshot(const ParticleSnapshot* i_snapshot, float alpha); // particle state to draw, alpha in [0,1] blends previous -> current solver frame
+    void setVolumeResolution(int resolution); // ray march a baked volume this many voxels across, 0 = evaluate particles per pixel
+    void setRayMarchScale(float scale); // fraction of the screen resolution the ray marcher runs at, 1 = full resolution
+    void setTemporalMode(bool enabled); // march a quarter of the pixels per frame, reproject the rest from the last frame (per-particle path only)
+    void setImpostorMode(bool enabled); // Phong preview: ray-cast sphere impostors instead of the sphere mesh
+    void setSurfaceMeshMode(bool enabled); // Phong preview: draw the marching-cubes surface (SurfaceExtractor) instead of the particles
+    void setLightShadows(bool enabled); // ray marcher with a volume resolution: dim the scene light by the fluid it passes through (LightTransmittance)
+    void setRayMarchQuality(RayMarchQuality quality);
 
     void CreateGraphicsPipelines();
     void RenderScene();
     void RenderScene_RayMarch();
+    void RenderScene_ScreenSpaceFluid(); // faster stand-in for the ray marcher: cost scales with pixels, not particles x steps
     void CleanUp();
 
     // All for RayMarching
@@ -50,21 +72,177 @@ private:
     int screenWidth;
     int screenHeight; 
     Scene* mainScene;
+    const ParticleSnapshot* snapshot;
+    ParticleSpan<glm::vec3> renderPositions; // positions to draw this frame - the snapshot itself, or interpolatedPositions
+    std::vector<glm::vec3> interpolatedPositions; // snapshot positions interpolated to the current render time
 
     float rotZ; // for container
 
     GLuint gGraphicsPipelineShaderProgram = 0;
     GLuint gGraphicsLighterPipelineShaderProgram = 0;
-    GLuint gGraphicsRayMarchingPipelineShaderProgram = 0;
+    GLuint gGraphicsRayMarchingPipelineShaderProgram = 0; // the permutation for rayMarchQuality
+    GLuint gGraphicsUpsamplePipelineShaderProgram = 0;
+    GLuint gGraphicsImpostorPipelineShaderProgram = 0;
+    GLuint gGraphicsFluidDepthPipelineShaderProgram = 0;
+    GLuint gGraphicsFluidThicknessPipelineShaderProgram = 0;
+    GLuint gGraphicsFluidSmoothPipelineShaderProgram = 0;
+    GLuint gGraphicsFluidCompositePipelineShaderProgram = 0;
+
+    // Programs are loaded from the on-disk binary cache when it has them, built from source (and stored) otherwise
+    ShaderCache shaderCache;
+    RayMarchQuality rayMarchQuality;
+    GLuint gGraphicsRayMarchingPermutationPrograms[RAY_MARCH_QUALITY_COUNT] = {};
+
+    // Per-frame camera, projection and light, shared by every program through one uniform buffer
+    // --> Same std140 layout as the FrameState block in the shaders: vec3s are padded to 16 bytes
+    struct FrameState{
+        glm::mat4 viewMatrix;
+        glm::mat4 projection;
+        glm::vec3 viewPosition;
+        float padding0;
+        glm::vec3 lightColor;
+        float padding1;
+        glm::vec3 lightPosition;
+        float padding2;
+    };
+    static constexpr GLuint FRAME_STATE_BINDING = 0; // uniform buffer binding point of the FrameState block
+    FrameState frameState; // this frame's contents of frameStateBuffer
+    GLuint frameStateBuffer = 0;
+    glm::mat4 projection; // the screen size is fixed, so the perspective is computed once
+
+    // Uniform locations, looked up once after linking - uniforms a shader does not use come back as -1, which glUniform* ignores
+    // --> Samplers keep fixed texture units, so they are set at link time and never looked up again
+    struct LighterUniforms{
+        GLint modelMatrix = -1;
+    };
+    struct RayMarchUniforms{
+        GLint iResolution = -1;
+        GLint iTime = -1;
+        GLint particleCount = -1;
+        GLint useVolume = -1;
+        GLint fluidBoundsMin = -1;
+        GLint fluidBoundsMax = -1;
+        GLint gridOrigin = -1;
+        GLint gridDims = -1;
+        GLint cellSize = -1;
+        GLint maxRadius = -1;
+        GLint tileCounts = -1;
+        GLint volumeOrigin = -1;
+        GLint voxelSize = -1;
+        GLint useLightShadows = -1;
+        GLint transmittanceOrigin = -1;
+        GLint transmittanceVoxelSize = -1;
+        GLint temporalMode = -1;
+        GLint temporalPhase = -1;
+        GLint previousViewProjection = -1;
+        GLint previousCameraPosition = -1;
+    };
+    struct FluidSmoothUniforms{
+        GLint direction = -1;
+        GLint smoothingRadius = -1;
+        GLint projectionScale = -1;
+    };
+    LighterUniforms lighterUniforms;
+    RayMarchUniforms rayMarchUniforms; // of gGraphicsRayMarchingPipelineShaderProgram
+    RayMarchUniforms rayMarchPermutationUniforms[RAY_MARCH_QUALITY_COUNT];
+    FluidSmoothUniforms fluidSmoothUniforms;
+
+    // Model handles, copied out of the scene once in VertexSpecification()
+    MeshHandles particleMesh;
+    MeshHandles boxMesh;
+    MeshHandles lightMesh;
+
+    // Sphere impostors: one instanced quad per particle, the fragment shader ray casts the sphere inside it
+    bool impostorMode;
+    GLuint gImpostorVertexArrayObject = 0;
+    GLuint gImpostorVertexBufferObject = 0;
+
+    // Offscreen target for ray marching below screen resolution, or with temporal reprojection
+    struct RayMarchTarget{
+        GLuint framebuffer = 0;
+        GLuint colorTexture = 0;
+        GLuint geometryTexture = 0; // normal + hit distance, guides the upsample and the reprojection
+        GLuint motionTexture = 0; // how far the surface seen by each pixel moved over the last frame
+    };
+    float rayMarchScale;
+    int rayMarchWidth; // resolution the ray marcher runs at this frame
+    int rayMarchHeight;
+    RayMarchTarget rayMarchTargets[2]; // current frame + history when temporal mode ping-pongs between them
+    int currentRayMarchTarget;
+    glm::ivec2 rayMarchTargetSize; // allocated size of the targets above
+    GLint screenFramebuffer = 0; // framebuffer to upsample into - 0 for the window
+
+    // Temporal reprojection
+    bool temporalMode;
+    bool historyValid; // the other target holds last frame at the current size
+    int temporalPhase; // which block of every 2x2 group of pixel blocks is marched this frame
+    glm::mat4 previousViewProjection;
+    glm::vec3 previousCameraPosition;
+    std::vector<glm::vec3> previousRenderPositions; // per particle, last frame's renderPositions
+    std::vector<glm::vec4> sortedMotion; // per sorted particle, movement since last frame
+    ParticleUploadRing particleMotionRing; // per-frame sortedMotion for the ray marcher
+
+    ParticleUploadRing particleInstanceRing; // per-frame instance data for the Phong preview and the screen-space fluid
+
+    // Fluid surface mesh for the Phong preview, re-extracted and re-uploaded every frame
+    bool surfaceMeshMode;
+    SurfaceExtractor surfaceExtractor;
+    std::vector<GLfloat> surfaceVertexData; // interleaved like the model meshes: position, color, normal
+    GLuint gSurfaceVertexArrayObject = 0;
+    GLuint gSurfaceVertexBufferObject = 0;
+    GLuint gSurfaceIndexBufferObject = 0;
+
+    // Screen-space fluid: sphere impostor depths and summed thickness splatted offscreen, the depth smoothed, then shaded
+    // --> Allocated at screen size on first use; the smoothing ping-pongs between the two depth textures
+    struct FluidTarget{
+        GLuint depthFramebuffer = 0; // depthTextures[0] + depthRenderbuffer, for the depth splat
+        GLuint smoothFramebuffers[2] = {0, 0}; // one per depth texture
+        GLuint thicknessFramebuffer = 0;
+        GLuint depthTextures[2] = {0, 0}; // distance in front of the camera, 0 = no fluid
+        GLuint thicknessTexture = 0;
+        GLuint depthRenderbuffer = 0;
+    };
+    FluidTarget fluidTarget;
+    // Blended / summed particle density: the ray marcher smooth-mins distances before taking density, the thickness pass
+    // adds up every particle's own density, so overlaps count twice while the blend's outward pull is missing
+    // --> Measured over the baked volume: 1.2 for a 10x10x10 block; it drops as the fluid gets deeper (overlaps win) and
+    //     rises for small splashes (the blend wins) - 0.7 to 1.5 between 8000 and 125 settled particles
+    static constexpr float FLUID_DENSITY_OVERLAP = 1.2f;
+    float fluidSmoothingRadius; // world units the depth smoothing reaches, about one and a half particle radii
+    int fluidSmoothingIterations; // horizontal + vertical passes
+
+    float blendFactor; // smooth-min blend distance between particles in the ray marcher - compiled into its programs
+    ParticleGrid particleGrid; // rebuilt every frame so map() only visits nearby particles
+    ParticleUploadRing particleRing; // per-frame particle data for the ray marcher, sorted by grid cell
+    ParticleUploadRing cellStartRing; // per-frame grid cell offsets into particleRing
+    TileCuller tileCuller; // rebuilt every frame so map() can stick to the particles visible in its screen tile
+    ParticleUploadRing tileParticleRing; // per-frame tile lists, indices into particleRing
+    ParticleUploadRing tileStartRing; // per-frame tile offsets into tileParticleRing
+    bool useVolume;
+    bool volumeThisFrame; // useVolume, or this frame's particle lists did not fit the texture buffers (PreDraw_RM)
+    bool particleListsOverflowed; // the last frame fell back to the volume for that reason - reported once per overflow
+    ParticleVolume particleVolume; // baked distance + density, replaces the per-particle map() when volumeThisFrame is set
+    GLuint volumeTexture = 0;
+    glm::ivec3 volumeTextureDims; // allocated size of volumeTexture
+    bool lightShadows;
+    LightTransmittance lightTransmittance; // rebuilt from particleVolume every frame when lightShadows and useVolume are set
+    GLuint transmittanceTexture = 0;
+    glm::ivec3 transmittanceTextureDims; // allocated size of transmittanceTexture
 
     std::string LoadShaderAsString(const std::string& filename);
     GLuint CreateShaderProgram(const std::string& vertexShaderSource, const std::string& fragmentShaderSource);
+    std::string AddShaderDefines(const std::string& source, const std::string& defines); // inserted after the #version line
+    std::string RayMarchDefines(RayMarchQuality quality);
     GLuint CompileShader(GLuint type, const std::string& source);
+    void ResolveUniformLocations(); // after linking, see LighterUniforms / RayMarchUniforms
+    void BindFrameState(GLuint shaderProgram); // point the program's FrameState block at FRAME_STATE_BINDING
+    void UpdateFrameState(); // once per frame, before any draw
 
     void PreDraw();
     void DrawParticles(int gTotalIndices);
-    void PreDrawParticle(int i);
-    void DrawParticle(int i, int gTotalIndices);
+    void DrawParticleInstances(int gTotalIndices, int numInstances);
+    void DrawParticleImpostors(int numInstances);
+    void DrawSurfaceMesh();
     void DrawLights(int gTotalIndices);
     void PreDrawLight();
     void DrawLight(int gTotalIndices);
@@ -73,7 +251,17 @@ private:
     void DrawBoxActually(int gBoxTotalIndices);
 
     void PreDraw_RM(); // for RayMarching
+    void UploadVolume(); // for RayMarching
+    void UploadLightTransmittance(); // for RayMarching
+    void BeginRayMarchTarget(); // for RayMarching below screen resolution
+    void CreateRayMarchTarget(RayMarchTarget& target); // (re)allocate at rayMarchWidth x rayMarchHeight
+    void UpsampleRayMarchTarget(); // for RayMarching below screen resolution
     void Draw_RM(); // for RayMarching
+
+    void CreateFluidTarget(); // for the screen-space fluid
+    void DrawFluidSplats(int numInstances); // for the screen-space fluid
+    void SmoothFluidDepth(); // for the screen-space fluid
+    void DrawFluidComposite(); // for the screen-space fluid
     
 };
 
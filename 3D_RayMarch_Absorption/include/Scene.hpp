@@ -27,37 +27,28 @@ public:
     ~Scene();
     
     void SetupScene(int numParticles, float size); // Calls SetupSolverAndLights()
-    void SetupSceneWithCuboidSetup(int w, int b, int h, float r);  // Calls SetupCuboidSolverLightsAndContainer()
+    void SetupSceneWithCuboidSetup(int w, int b, int h, float r, bool uploadModels = true);  // Calls SetupCuboidSolverLightsAndContainer(), uploadModels = false without a GL context
     void addLight(glm::vec3 position, float radius);
     void updateBoxRotationZ(float val);
     
-    // vvvvvvvvvvvvvvvvvvvvvvvvvv Set Functions vvvvvvvvvvvvvvvvvvvvvvvvvv
-    void InitializeGLuints();
-
     // vvvvvvvvvvvvvvvvvvvvvvvvvv Get Functions vvvvvvvvvvvvvvvvvvvvvvvvvv
     bool getIfCuboidSolverSetup();
     std::vector<Particle*> getLights();
     Solver* getSolver();
     Camera* getCamera();
     Container* getBox();
-    std::unordered_map<std::string, std::vector<GLuint>> getGVertexArrayObjects_map();
-    std::unordered_map<std::string, std::vector<GLuint>> getGVertexBufferObjects_map();
-    int getObjTotalIndices(std::string objName);
+    MeshHandles getMesh(const std::string& objName); // "Particle", "Light" or "Box", once the scene is set up
     
 
 private:
     std::vector<Particle*> lights; 
 
-    std::unordered_map<std::string, std::vector<GLuint>> gVertexArrayObjects_map; 
-    std::unordered_map<std::string, std::vector<GLuint>> gVertexBufferObjects_map;
-
     Solver* gSolver;
     Camera* gCamera;
     Container gBox;
     ModelProcessor *gModelProcessor;
 
     bool cuboidSolverSetup; // Cuboid particle setup or free drip setup
-
     void SetupSolverLightsAndContainer(int numParticles, float size); // Calls SetUpSolver() and SetUpLights()
     void SetUpSolver(int numParticles, float size);
 
@@ -0,0 +1,46 @@
+#include <SDL2/SDL.h>
+#include <glad/glad.h>
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+
+#include "MappedFile.hpp"
+#include "Hash.hpp"
+
+#ifndef SHADER_CACHE_HPP
+#define SHADER_CACHE_HPP
+
+// Linked shader programs kept on disk (glGetProgramBinary), so later launches skip compiling and linking
+// --> An entry is named by a hash of both shader sources - after any #defines were added - and of the driver
+//     (vendor, renderer, version strings), so an edited shader or an updated driver simply misses
+// --> Drivers may reject a binary they wrote themselves; that program is then built from source and its entry rewritten
+// --> Without GL_ARB_get_program_binary, or with no binary formats, nothing is stored and every program is compiled
+class ShaderCache{
+public:
+    ShaderCache();
+
+    void Initialize(); // after the GL context exists - entries go to shader_cache/ next to the executable
+    bool isEnabled();
+    uint64_t Key(const std::string& vertexSource, const std::string& fragmentSource);
+    GLuint Load(uint64_t key); // a linked program, or 0 on a miss
+    void Store(uint64_t key, GLuint program); // program must be linked with GL_PROGRAM_BINARY_RETRIEVABLE_HINT set
+    int getHitCount();
+    int getMissCount();
+
+private:
+    bool enabled;
+    std::string directory;
+    std::string driver;
+    int hits;
+    int misses;
+
+    std::string EntryPath(uint64_t key);
+};
+
+#endif
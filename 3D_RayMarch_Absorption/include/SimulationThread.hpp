@@ -0,0 +1,60 @@
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <vector>
+
+#include "Solver.hpp"
+#include "Scene.hpp"
+#include "ParticleSnapshot.hpp"
+
+#ifndef SIMULATION_THREAD_HPP
+#define SIMULATION_THREAD_HPP
+
+// Runs the Solver on its own thread so simulation and rendering overlap
+// --> The solver advances in fixed steps of step_dt driven by a wall-clock accumulator, independent of render speed
+// --> After every completed solver frame, a snapshot of the particle positions is published to a triple buffer
+// --> The render thread reads the latest snapshot and never touches the Solver directly
+// --> Anything that changes the simulation from the main thread goes through a request (applied between frames)
+class SimulationThread{
+public:
+    SimulationThread(Solver* i_solver, Scene* i_scene);
+    ~SimulationThread();
+
+    void start(); // publishes the initial state, then launches the thread
+    void stop();
+
+    void setPaused(bool i_paused);
+    void requestParticleActivation(int index);
+    void requestBoxRotationZ(float val);
+
+    const ParticleSnapshot& getLatestSnapshot(); // render thread only
+
+    SimulationThread(const SimulationThread&) = delete;
+    SimulationThread& operator=(const SimulationThread&) = delete;
+
+private:
+    Solver* solver;
+    Scene* scene;
+
+    std::thread worker;
+    SnapshotBuffer snapshots;
+
+    std::atomic<bool> running;
+    bool paused;
+    std::mutex stateMutex; // guards paused and the pending requests below
+    std::condition_variable stateChanged;
+
+    std::vector<int> pendingActivations;
+    float pendingBoxRotationZ;
+
+    std::vector<glm::vec3> lastPublishedPositions;
+    static constexpr int MAX_CATCH_UP_STEPS = 4; // beyond this the simulation slows down instead of spiralling
+
+    void run();
+    void applyPendingRequests();
+    void publishSnapshot(std::chrono::steady_clock::time_point stepTime);
+};
+
+#endif
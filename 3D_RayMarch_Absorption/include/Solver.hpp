@@ -14,10 +14,14 @@
 #include <chrono>
 #include <thread>
 #include <mutex>
+#include <functional>
+#include <memory>
 
 #include "Particle.hpp"
 #include "Container.hpp"
 #include "SpatialMapUtils.hpp"
+#include "CounterRNG.hpp"
+#include "ParticleSnapshot.hpp"
 
 #ifndef SOLVER_HPP
 #define SOLVER_HPP
@@ -28,11 +32,16 @@ public:
     Solver(float particleSize, int i_numThreads); // particleSize refers to the radius of the particles
     ~Solver();
     void addParticle(glm::vec3 position, float radius, bool i_activated);
+    void addParticles(int count, const std::function<glm::vec3(int)>& positionAt, float radius, bool i_activated); // bulk emitter, positionAt(k) gives the k-th new particle's position
     void setupParticleLocks();
     void update(Container* gBox, int counter);
-    std::vector<Particle*> getParticles();
+    const std::vector<Particle*>& getParticles();
+    void writeSnapshot(ParticleSnapshot& snapshot); // copy the current particle state into a render snapshot
+    float getStepDt();
+    uint64_t getFrameCount(); // number of completed update() calls
     void activateNewParticle(int index); // activate particles[index]
     void printSolverInfo();
+    void setSeed(uint64_t seed); // reseeds the counter-based RNG - same seed, same run
 
     Solver(const Solver&) = delete;
     Solver& operator=(const Solver&) = delete;
@@ -40,7 +49,8 @@ public:
     Solver& operator=(Solver&&) = delete;
 
 private:
-    std::vector<Particle*> particles;
+    std::vector<Particle*> particles; // points into particleBlocks
+    std::vector<std::unique_ptr<Particle[]>> particleBlocks; // one allocation per addParticles() call (or addParticle())
     std::vector<std::unique_ptr<std::mutex>> particle_locks;
     glm::vec3 gravity;
     float step_dt;
@@ -52,6 +62,9 @@ private:
     std::unordered_map<Vec3i, std::vector<int>> spatialMap;
     float cell_size; // size of each cell in the spatial map
     int numThreads;
+    CounterRNG rng;
+    uint64_t frameCount;
+    uint64_t layoutVersion; // bumped whenever particles are added, so snapshots know when to recopy radii
 
     std::ofstream outFile;
 
@@ -71,6 +84,8 @@ private:
     void cacheParticleRadii();
     void cacheContainerInfo(Container* gBox);
     
+    glm::vec3 getSpawnVelocity(int particleID); // random initial velocity, keyed by particle ID
+    
     void applyGravity();
     Vec3i getCellIndex(glm::vec3 pos, float cellSize); // Get the cell index for a given position in the spatial map
     void applyContainer(Container* gBox);
@@ -82,6 +97,7 @@ private:
     void checkCollisionsWithSpatialHashing();
     void checkCollisionsWithSpatialHashing(int i_low, int i_high, int thread_id);
     void updateObjects(float dt);
+    void emitParticlesThread(Particle* block, int firstID, int startIdx, int endIdx, const std::function<glm::vec3(int)>& positionAt, float radius, bool i_activated);
 
     void updateParticle(int index);
 
@@ -0,0 +1,69 @@
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <string>
+#include <thread>
+#include <atomic>
+#include <unordered_map>
+#include <algorithm>
+#include <cstdint>
+
+#include "ParticleSnapshot.hpp"
+#include "ParticleGrid.hpp"
+#include "ParticleVolume.hpp"
+#include "MeshWriter.hpp"
+
+#ifndef SURFACE_EXTRACTOR_HPP
+#define SURFACE_EXTRACTOR_HPP
+
+// Triangle mesh of the fluid surface, extracted on the CPU by marching cubes - needs no GL context
+// --> The field is ParticleVolume's narrow-band signed distance, so the mesh is the same smooth-min surface the
+//     ray marcher draws; normals are the distance gradient
+// --> The volume is cut into BLOCK_SIZE^3-cell blocks; only blocks the surface passes through are marched, handed out
+//     to the worker threads one at a time
+// --> Each block shares the vertices of its cells' edges through its own hash table, so blocks never wait on each
+//     other; a vertex on a block face is repeated once per block that touches it (same position and normal)
+class SurfaceExtractor{
+public:
+    SurfaceExtractor();
+
+    void setResolution(int resolution); // voxels along the longest axis of the particle bounds (ParticleVolume)
+    void Extract(ParticleSpan<glm::vec3> positions, ParticleSpan<float> radii, ParticleSpan<uint8_t> flags, float blendFactor);
+
+    const std::vector<glm::vec3>& getPositions();
+    const std::vector<glm::vec3>& getNormals(); // unit length, pointing out of the fluid
+    const std::vector<uint32_t>& getIndices(); // three per triangle, counter-clockwise seen from outside
+    int getOccupiedBlockCount(); // blocks the last Extract() marched
+    bool SaveMesh(const std::string& path); // binary PLY, or OBJ if the path ends in .obj
+
+    static constexpr int BLOCK_SIZE = 8; // cells per block along each axis
+
+private:
+    struct BlockMesh{
+        std::vector<glm::vec3> positions;
+        std::vector<glm::vec3> normals;
+        std::vector<uint32_t> indices; // into this block's positions
+        std::unordered_map<uint64_t, uint32_t> edgeVertices; // voxel index * 3 + axis of a cell edge -> its vertex
+    };
+
+    int numThreads;
+
+    ParticleGrid particleGrid;
+    ParticleVolume particleVolume;
+
+    glm::ivec3 blockCounts;
+    std::vector<BlockMesh> blockMeshes; // one per block, kept between frames so their storage is reused
+    std::atomic<int> nextBlock;
+    std::atomic<int> occupiedBlocks;
+
+    std::vector<glm::vec3> positions;
+    std::vector<glm::vec3> normals;
+    std::vector<uint32_t> indices;
+
+    void ExtractBlocksThread();
+    void ExtractBlock(int blockIndex);
+    uint32_t EdgeVertex(BlockMesh& mesh, const glm::ivec3& voxel, int axis); // vertex where the surface crosses the edge
+    glm::vec3 Gradient(const glm::ivec3& voxel); // central differences of the distance
+};
+
+#endif
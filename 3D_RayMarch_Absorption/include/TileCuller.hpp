@@ -0,0 +1,48 @@
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <thread>
+#include <algorithm>
+
+#ifndef TILE_CULLER_HPP
+#define TILE_CULLER_HPP
+
+// Per screen tile lists of the particles whose (inflated) sphere can be seen in that tile, built on the CPU every frame
+// --> Each particle's sphere is projected with the same view and perspective the ray marcher uses
+// --> getTileStarts()[t] .. getTileStarts()[t + 1] is the range of getTileParticles() for tile t (row major, from the bottom left)
+// --> getTileParticles() holds indices into the particle array that was passed to Build()
+class TileCuller{
+public:
+    TileCuller();
+
+    static constexpr int TILE_SIZE = 16; // pixels
+
+    // inflation is added to every radius - a particle can change the surface this far past its own sphere
+    void Build(const std::vector<glm::vec4>& particles, const glm::mat4& view, const glm::mat4& projection,
+               int width, int height, float inflation);
+
+    const std::vector<int>& getTileStarts(); // numTiles + 1 offsets into getTileParticles()
+    const std::vector<int>& getTileParticles();
+    glm::ivec2 getTileCounts(); // tiles across and up
+
+private:
+    int numThreads;
+
+    const std::vector<glm::vec4>* particles; // only valid during Build()
+    glm::mat4 view;
+    float projectionX; // projection[0][0]
+    float projectionY; // projection[1][1]
+    float nearPlane;
+    float inflation;
+    glm::vec2 screenSize; // pixels
+
+    glm::ivec2 tileCounts;
+    std::vector<glm::ivec4> tileRects; // per particle: first tile x, y, last tile x, y (empty if last < first)
+    std::vector<int> tileStarts;
+    std::vector<int> tileCursor;
+    std::vector<int> tileParticles;
+
+    void ComputeRectsThread(int startIdx, int endIdx);
+};
+
+#endif
@@ -0,0 +1,75 @@
+#version 410 core
+
+in vec2 vUV;
+out vec4 fragColor;
+
+// Per-frame camera, projection and light, shared by every program (Renderer::FrameState)
+layout(std140) uniform FrameState {
+    mat4 u_ViewMatrix;
+    mat4 u_Projection;
+    vec3 i_viewPos;
+    vec3 i_lightColor;
+    vec3 i_lightPosition;
+};
+
+uniform sampler2D fluidDepth; // smoothed distance in front of the camera, 0 where there is no fluid
+uniform sampler2D fluidThickness; // summed density integrals, in the ray marcher's density units times world units
+uniform float absorptionPerUnit; // fragRayMarch.glsl's ABSORPTION per density sample over its DENSITY_STEP (set by the Renderer)
+uniform float thicknessScale; // blended / summed density (Renderer::FLUID_DENSITY_OVERLAP)
+
+// View-space position of the surface under a pixel
+vec3 viewPosition(ivec2 pixel, float depth) {
+    vec2 ndc = (vec2(pixel) + 0.5) / vec2(textureSize(fluidDepth, 0)) * 2.0 - 1.0;
+    return vec3(ndc.x / u_Projection[0][0], ndc.y / u_Projection[1][1], -1.0) * depth;
+}
+
+// Screen-space fluid, pass 4: normals from the smoothed depth, then the ray marcher's shading and Beer-Lambert absorption
+// --> Each derivative takes the side whose depth is closer, so normals do not bend over silhouettes
+void main()
+{
+    ivec2 pixel = ivec2(gl_FragCoord.xy);
+    ivec2 size = textureSize(fluidDepth, 0);
+    float depth = texelFetch(fluidDepth, pixel, 0).r;
+    if (depth <= 0.0) discard;
+
+    vec3 position = viewPosition(pixel, depth);
+    vec3 derivatives[2];
+    for (int axis = 0; axis < 2; axis++) {
+        ivec2 step = axis == 0 ? ivec2(1, 0) : ivec2(0, 1);
+        ivec2 forwardPixel = min(pixel + step, size - 1);
+        ivec2 backwardPixel = max(pixel - step, ivec2(0));
+        float forwardDepth = texelFetch(fluidDepth, forwardPixel, 0).r;
+        float backwardDepth = texelFetch(fluidDepth, backwardPixel, 0).r;
+        vec3 forward = viewPosition(forwardPixel, forwardDepth) - position;
+        vec3 backward = position - viewPosition(backwardPixel, backwardDepth);
+
+        bool forwardValid = forwardDepth > 0.0 && forwardPixel != pixel;
+        bool backwardValid = backwardDepth > 0.0 && backwardPixel != pixel;
+        if (forwardValid && (!backwardValid || abs(forward.z) <= abs(backward.z))) derivatives[axis] = forward;
+        else if (backwardValid) derivatives[axis] = backward;
+        else derivatives[axis] = axis == 0 ? vec3(1.0, 0.0, 0.0) : vec3(0.0, 1.0, 0.0); // lone pixel, face the camera
+    }
+    vec3 viewNormal = normalize(cross(derivatives[0], derivatives[1]));
+
+    // Back to world space: view = R * (world - eye)
+    mat3 cameraRotation = transpose(mat3(u_ViewMatrix));
+    vec3 normal = cameraRotation * viewNormal;
+    vec3 hitPos = i_viewPos + cameraRotation * position;
+
+    // Same lighting as getColor() in fragRayMarch.glsl
+    float ambient_strength = 0.6;
+    float diffuse_strength = 0.4;
+    vec3 ambient = ambient_strength * i_lightColor;
+    vec3 lightDir = normalize(i_lightPosition - hitPos);
+    float diff = max(dot(normal, lightDir), 0.0);
+    vec3 diffuse = diffuse_strength * diff * i_lightColor;
+    vec3 baseColor = vec3(0.0, 0.5, 0.8);
+
+    float thickness = thicknessScale * texelFetch(fluidThickness, pixel, 0).r;
+    float transmission = exp(-absorptionPerUnit * thickness);
+    fragColor = vec4((ambient + diffuse) * baseColor * transmission, 1.0);
+
+    // Depth of the smoothed surface, so the box is drawn in front of or behind the fluid correctly
+    vec4 clipPos = u_Projection * vec4(position, 1.0);
+    gl_FragDepth = (clipPos.z / clipPos.w) * 0.5 + 0.5;
+}
@@ -0,0 +1,36 @@
+#version 410 core
+
+in vec3 FragPos;
+in vec3 sphereCenter;
+in float sphereRadius;
+in vec3 u_viewPos;
+
+// Per-frame camera, projection and light, shared by every program (Renderer::FrameState)
+layout(std140) uniform FrameState {
+    mat4 u_ViewMatrix;
+    mat4 u_Projection;
+    vec3 i_viewPos;
+    vec3 i_lightColor;
+    vec3 i_lightPosition;
+};
+
+out float fluidDepth; // distance in front of the camera, 0 where there is no fluid
+
+// Screen-space fluid, pass 1: depth of the nearest sphere front under each pixel (same ray cast as fragImpostor.glsl)
+void main()
+{
+    vec3 rayDir = normalize(FragPos - u_viewPos);
+    vec3 centerToEye = u_viewPos - sphereCenter;
+    float b = dot(centerToEye, rayDir);
+    float c = dot(centerToEye, centerToEye) - sphereRadius * sphereRadius;
+    float discriminant = b * b - c;
+    if (discriminant < 0.0) discard; // quad corner outside the silhouette
+
+    float t = -b - sqrt(discriminant);
+    vec3 hitPos = u_viewPos + t * rayDir;
+
+    vec4 viewPos = u_ViewMatrix * vec4(hitPos, 1.0);
+    vec4 clipPos = u_Projection * viewPos;
+    gl_FragDepth = (clipPos.z / clipPos.w) * 0.5 + 0.5;
+    fluidDepth = -viewPos.z;
+}
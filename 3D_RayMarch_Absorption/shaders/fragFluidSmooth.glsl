@@ -0,0 +1,47 @@
+#version 410 core
+
+in vec2 vUV;
+out float smoothedDepth;
+
+uniform sampler2D fluidDepth; // distance in front of the camera, 0 where there is no fluid
+uniform ivec2 direction; // (1, 0) or (0, 1) - the filter runs as a horizontal then a vertical pass
+uniform float smoothingRadius; // world units
+uniform float projectionScale; // pixels covered by one world unit at distance 1
+
+const int maxKernelRadius = 16; // pixels, caps the cost when the camera is close to the fluid
+const float depthFalloff = 0.1; // world units of depth difference at which a neighbour's weight drops to 1/e
+
+// Screen-space fluid, pass 3: separable bilateral filter over the sphere depths
+// --> The kernel covers smoothingRadius in world units, so the fluid is equally smooth near and far
+// --> Neighbours at a different depth (another layer of fluid, or across a silhouette) are weighted down,
+//     which flattens the bumps between spheres without melting separate surfaces into each other
+// --> Background pixels are left alone, so the silhouette does not grow or shrink
+void main()
+{
+    ivec2 pixel = ivec2(gl_FragCoord.xy);
+    float depth = texelFetch(fluidDepth, pixel, 0).r;
+    if (depth <= 0.0) {
+        smoothedDepth = 0.0;
+        return;
+    }
+
+    ivec2 size = textureSize(fluidDepth, 0);
+    float kernelRadius = min(smoothingRadius * projectionScale / depth, float(maxKernelRadius));
+    int radius = int(ceil(kernelRadius));
+    float spatialScale = 2.0 / max(kernelRadius * kernelRadius, 1.0); // sigma = half the kernel radius
+
+    float sum = 0.0;
+    float totalWeight = 0.0;
+    for (int i = -radius; i <= radius; i++) {
+        ivec2 texel = clamp(pixel + i * direction, ivec2(0), size - 1);
+        float sampleDepth = texelFetch(fluidDepth, texel, 0).r;
+        if (sampleDepth <= 0.0) continue;
+
+        float depthDifference = (sampleDepth - depth) / depthFalloff;
+        float weight = exp(-float(i * i) * spatialScale - depthDifference * depthDifference);
+        sum += weight * sampleDepth;
+        totalWeight += weight;
+    }
+
+    smoothedDepth = sum / totalWeight;
+}
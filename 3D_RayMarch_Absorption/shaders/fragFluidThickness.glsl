@@ -0,0 +1,27 @@
+#version 410 core
+
+in vec3 FragPos;
+in vec3 sphereCenter;
+in float sphereRadius;
+in vec3 u_viewPos;
+
+out float fluidThickness; // summed over every sphere under the pixel by additive blending
+
+// Screen-space fluid, pass 2: the density the ray marcher would pick up along the eye ray through this particle alone
+// --> fragRayMarch.glsl's density is max(densityBand - d, 0), which for one particle is R - |p - center| inside the
+//     sphere grown by the band (R = sphereRadius, vertImpostor.glsl) - its integral over the chord is R s - q^2 ln((R + s) / q),
+//     with s the half chord and q the ray's distance from the center
+// --> No depth test, every sphere counts; the grown spheres also overlap their neighbours, so no gaps show between them
+void main()
+{
+    vec3 rayDir = normalize(FragPos - u_viewPos);
+    vec3 centerToEye = u_viewPos - sphereCenter;
+    float b = dot(centerToEye, rayDir);
+    float c = dot(centerToEye, centerToEye) - sphereRadius * sphereRadius;
+    float discriminant = b * b - c;
+    if (discriminant < 0.0) discard; // quad corner outside the silhouette
+
+    float halfChord = sqrt(discriminant);
+    float distanceSquared = max(sphereRadius * sphereRadius - discriminant, 1e-8); // q^2
+    fluidThickness = sphereRadius * halfChord - 0.5 * distanceSquared * log((sphereRadius + halfChord) * (sphereRadius + halfChord) / distanceSquared);
+}
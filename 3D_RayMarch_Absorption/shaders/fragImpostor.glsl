@@ -0,0 +1,64 @@
+#version 410 core
+
+in vec3 FragPos;
+in vec3 sphereCenter;
+in float sphereRadius;
+
+in vec3 u_lightColor;
+in vec3 u_lightPosition;
+in vec3 u_viewPos;
+
+// Per-frame camera, projection and light, shared by every program (Renderer::FrameState)
+layout(std140) uniform FrameState {
+    mat4 u_ViewMatrix;
+    mat4 u_Projection;
+    vec3 i_viewPos;
+    vec3 i_lightColor;
+    vec3 i_lightPosition;
+};
+
+out vec4 color;
+
+// Entry point of program
+void main()
+{
+    // Exact ray-sphere intersection along the eye ray through this fragment
+    vec3 rayDir = normalize(FragPos - u_viewPos);
+    vec3 centerToEye = u_viewPos - sphereCenter;
+    float b = dot(centerToEye, rayDir);
+    float c = dot(centerToEye, centerToEye) - sphereRadius * sphereRadius;
+    float discriminant = b * b - c;
+    if (discriminant < 0.0) discard; // quad corner outside the silhouette
+
+    float t = -b - sqrt(discriminant);
+    vec3 hitPos = u_viewPos + t * rayDir;
+
+    // Depth of the sphere surface, not of the quad, so spheres intersect each other and the box correctly
+    vec4 clipPos = u_Projection * u_ViewMatrix * vec4(hitPos, 1.0);
+    gl_FragDepth = (clipPos.z / clipPos.w) * 0.5 + 0.5;
+
+    // Same lighting as fragPhong.glsl, with the sphere's exact normal
+    float ambient_strength = 0.1;
+    float diffuse_strength = 0.4;
+    float specular_strength = 0.5;
+    float shininess = 32;
+    vec3 objectColor = vec3(0.0, 0.0, 1.0); // vertex color of the particle mesh (ModelProcessor)
+
+    // Calculations for ambient lighting
+    vec3 ambient = ambient_strength * u_lightColor;
+
+    // Calculations for diffuse lighting 
+    vec3 normals  = (hitPos - sphereCenter) / sphereRadius;
+    vec3 lightDir = normalize(u_lightPosition - hitPos);  
+    float diff = max(dot(normals, lightDir), 0.0);
+    vec3 diffuse = diffuse_strength * diff * u_lightColor;
+
+    // Calculations for specular lighting
+    vec3 viewDir = -rayDir;
+    vec3 reflectDir = reflect(-lightDir, normals);  
+    float spec = pow(max(dot(viewDir, reflectDir), 0.0), shininess);
+    vec3 specular = specular_strength * spec * u_lightColor;  
+
+    vec3 lightColor_x_objectColor = (ambient + diffuse + specular) * objectColor;
+	color = vec4(lightColor_x_objectColor, 1.0f);
+}
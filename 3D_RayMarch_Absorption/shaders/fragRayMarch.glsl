@@ -1,15 +1,105 @@
 #version 410 core
 
+// Quality knobs, defined by the Renderer for each permutation it links (RayMarchDefines()) - the defaults are the high level
+#ifndef MAX_MARCH_STEPS
+#define MAX_MARCH_STEPS 100 // sphere-tracing steps to find the surface
+#endif
+#ifndef MAX_DENSITY_STEPS
+#define MAX_DENSITY_STEPS 100 // absorption march steps behind the surface
+#endif
+#ifndef DENSITY_STEP
+#define DENSITY_STEP 0.1 // distance between absorption samples
+#endif
+#ifndef DENSITY_SAMPLE_WEIGHT
+#define DENSITY_SAMPLE_WEIGHT 1.0 // DENSITY_STEP / 0.1, the step the absorption is calibrated for (LightTransmittance::DENSITY_STEP)
+#endif
+#ifndef ABSORPTION
+#define ABSORPTION 0.1 // LightTransmittance::ABSORPTION
+#endif
+#ifndef BLEND_FACTOR
+#define BLEND_FACTOR 0.5 // Renderer::blendFactor, which also sizes the CPU-side grid and culling
+#endif
+
 in vec2 vUV;
-out vec4 fragColor;
+layout(location = 0) out vec4 fragColor;
+layout(location = 1) out vec4 fragGeometry; // xyz = normal, w = hit distance - guides the upsample when rendering below screen resolution
+layout(location = 2) out vec4 fragMotion; // xyz = how far the surface seen here moved over the last frame - guides the next frame's reprojection
+
+// Per-frame camera, projection and light, shared by every program (Renderer::FrameState)
+layout(std140) uniform FrameState {
+    mat4 u_ViewMatrix;
+    mat4 u_Projection;
+    vec3 i_viewPos;
+    vec3 i_lightColor;
+    vec3 i_lightPosition;
+};
 
 uniform vec2 iResolution;
-uniform vec3 cameraPosition;
-uniform mat3 cameraRotation;
 uniform float iTime;
 
 uniform int particleCount;
-uniform vec3 particlePositions[1000];
+uniform samplerBuffer particleData; // one texel per active particle: xyz = position, w = radius, sorted by grid cell
+uniform samplerBuffer particleMotion; // same order as particleData: xyz = movement since last frame
+uniform isamplerBuffer cellStarts; // cellStarts[c] .. cellStarts[c + 1] is the range of particleData in cell c
+
+// Uniform grid built on the CPU every frame (ParticleGrid)
+// --> cellSize covers the blend radius, so only the 3x3x3 cells around a sample can change the surface there
+uniform vec3 gridOrigin;
+uniform ivec3 gridDims;
+uniform float cellSize;
+uniform float maxRadius;
+const float blendFactor = BLEND_FACTOR;
+
+// Screen tile lists (TileCuller): the particles whose blend-inflated sphere reaches into each 16x16 pixel tile
+// --> Rays never leave their tile, so the tile list holds every particle that can shape what this pixel sees
+uniform isamplerBuffer tileParticles; // indices into particleData
+uniform isamplerBuffer tileStarts; // tileStarts[t] .. tileStarts[t + 1] is the range of tileParticles in tile t
+uniform ivec2 tileCounts;
+const int tileSize = 16;
+
+// This pixel's range of tileParticles, set once in main()
+int tileFirst = 0;
+int tileLast = 0;
+
+// Baked volume (ParticleVolume): x = narrow-band signed distance, y = density, trilinear filtered
+// --> When useVolume is set both map() and accumulateDensity() read it instead of visiting particles
+uniform bool useVolume;
+uniform sampler3D volumeTexture;
+uniform vec3 volumeOrigin; // center of the first voxel
+uniform float voxelSize;
+
+// Deep shadow grid (LightTransmittance): fraction of the light that reaches each point through the fluid, trilinear filtered
+// --> Built on the CPU every frame; outside the grid nothing stands between a point and the light
+uniform bool useLightShadows;
+uniform sampler3D lightTransmittance;
+uniform vec3 transmittanceOrigin; // center of the first voxel
+uniform float transmittanceVoxelSize;
+
+// Box around every particle plus its blend and density falloff, from the CPU - rays only march inside it
+uniform vec3 fluidBoundsMin;
+uniform vec3 fluidBoundsMax;
+
+// Temporal reprojection: each frame only one of every 2x2 group of pixel blocks is marched (the one matching temporalPhase),
+// the other three follow their surface back into last frame's targets and reuse what was found there
+// --> A reprojected hit must land on this ray and on the current surface, otherwise the pixel is marched after all
+// --> temporalMode is only set when the history really is last frame at this resolution
+uniform bool temporalMode;
+uniform int temporalPhase;
+uniform sampler2D historyColor;
+uniform sampler2D historyGeometry;
+uniform sampler2D historyMotion;
+uniform mat4 previousViewProjection;
+uniform vec3 previousCameraPosition;
+const int temporalBlockSize = 8;
+
+// Particle nearest to the last point evaluateParticles() computed a gradient at - its motion becomes the surface motion
+int nearestParticle = -1;
+float nearestDistance = 0.0;
+
+const float maxDistance = 100.0;
+const float densityBand = 0.2; // density reaches zero this far outside the surface (ParticleVolume::DENSITY_BAND)
+const float absorption = ABSORPTION; // You can try values like 0.5, 1.0, 2.0 to control how strong the absorption is
+const float opaqueDensity = 5.5 / absorption; // transmission exp(-5.5) is below one 8-bit color step
 
 // Signed distance
 // --> If the distance is positive, the point is outside the sphere.
@@ -39,67 +129,245 @@ float smoothMinimum(float dSDSphere, float dSDBox, float blendFactor) {
     return mix(dSDBox, dSDSphere, weight) - blendFactor * weight * (1.0 - weight);
 }
 
-// Scene SDF — blend a moving sphere and box
-float map(vec3 pos) {
-    if (particleCount == 0) return 10000.0; // no particles, return large distance
+// smoothMinimum() that also blends the gradients (.yzw) of its two inputs
+// --> The derivative of the blend with respect to weight is zero, so the gradient is the same mix of both gradients
+vec4 smoothMinimumGradient(vec4 a, vec4 b, float blendFactor) {
+    float weight = clamp(0.5 + 0.5 * (b.x - a.x) / blendFactor, 0.0, 1.0);
+    vec4 blended = mix(b, a, weight);
+    blended.x -= blendFactor * weight * (1.0 - weight);
+    return blended;
+}
 
+// Distance from pos to the box [boxMin, boxMax], 0 inside
+float distanceToBox(vec3 pos, vec3 boxMin, vec3 boxMax) {
+    vec3 outside = max(max(boxMin - pos, pos - boxMax), 0.0);
+    return length(outside);
+}
+
+// Baked distance and density at pos, only valid inside the volume
+vec2 sampleVolume(vec3 pos) {
+    vec3 uvw = ((pos - volumeOrigin) / voxelSize + 0.5) / vec3(textureSize(volumeTexture, 0));
+    return texture(volumeTexture, uvw).xy;
+}
+
+// Light left after passing through the fluid between pos and the light, 1 = fully lit
+float sampleLightTransmittance(vec3 pos) {
+    if (!useLightShadows) return 1.0;
+    vec3 coord = (pos - transmittanceOrigin) / transmittanceVoxelSize + 0.5;
+    vec3 dims = vec3(textureSize(lightTransmittance, 0));
+    if (any(lessThan(coord, vec3(0.0))) || any(greaterThan(coord, dims))) return 1.0;
+    return texture(lightTransmittance, coord / dims).r;
+}
+
+// Distance from pos to the volume's voxel centers, 0 inside
+float distanceToVolume(vec3 pos) {
+    vec3 volumeMax = volumeOrigin + vec3(textureSize(volumeTexture, 0) - 1) * voxelSize;
+    return distanceToBox(pos, volumeOrigin, volumeMax);
+}
+
+// Scene SDF from the baked volume - the volume is padded past the blend radius, so outside it is empty space
+float mapVolume(vec3 pos) {
+    float boxDist = distanceToVolume(pos);
+    if (boxDist > 0.0) return boxDist + 0.5 * voxelSize;
+    return sampleVolume(pos).x;
+}
+
+// Smooth-min one more particle (particleData[index]) into dist (.x distance, .yzw gradient if withGradient)
+void blendParticle(inout vec4 dist, inout bool found, vec3 pos, int index, bool withGradient) {
+    vec4 particle = texelFetch(particleData, index);
     // pos - spherePos is a vector from spherePos --> pos (spherePos --> currentPosition)
-	// second param = radius of sphere
-    float dist = sdSphere(pos - particlePositions[0], 0.2);
+    // second param = radius of sphere
+    vec3 toPos = pos - particle.xyz;
+    float d = sdSphere(toPos, particle.w);
+    if (withGradient) {
+        // Gradient of a sphere SDF is the unit vector from its center
+        vec4 sphere = vec4(d, toPos / max(d + particle.w, 1e-6));
+        dist = found ? smoothMinimumGradient(dist, sphere, blendFactor) : sphere;
+        if (!found || d < nearestDistance) {
+            nearestParticle = index;
+            nearestDistance = d;
+        }
+    }
+    else {
+        dist.x = found ? smoothMinimum(dist.x, d, blendFactor) : d;
+    }
+    found = true;
+}
+
+// Distance (.x) and gradient (.yzw) of the particle surface near pos
+// --> Only the particles in the 3x3x3 cells around pos or in this pixel's tile are visited,
+//     so the cost follows local density, not particleCount
+// --> Anything further out is at least farDistance away, which keeps the march step conservative in empty space
+// --> withGradient is a constant at every call site, so map() compiles without any of the gradient math
+vec4 evaluateParticles(vec3 pos, bool withGradient) {
+    float farDistance = cellSize - maxRadius - 0.25 * blendFactor;
+
+    vec3 gridMax = gridOrigin + vec3(gridDims) * cellSize;
+    float boxDist = distanceToBox(pos, gridOrigin, gridMax);
+    if (boxDist > 0.0) return vec4(boxDist + farDistance, 0.0, 0.0, 0.0); // outside the grid, step straight towards it
+
+    ivec3 cell = clamp(ivec3(floor((pos - gridOrigin) / cellSize)), ivec3(0), gridDims - 1);
+    ivec3 lo = max(cell - 1, ivec3(0));
+    ivec3 hi = min(cell + 1, gridDims - 1);
+
+    // Visit whichever is shorter: this pixel's tile list or the particles in the 3x3x3 cells around pos
+    int gridCount = 0;
+    for (int z = lo.z; z <= hi.z; z++) {
+        for (int y = lo.y; y <= hi.y; y++) {
+            // Cells along x are contiguous, so the whole row is one range of particleData
+            int rowStart = (z * gridDims.y + y) * gridDims.x;
+            gridCount += texelFetch(cellStarts, rowStart + hi.x + 1).r - texelFetch(cellStarts, rowStart + lo.x).r;
+        }
+    }
 
-    for (int i = 1; i < particleCount; i++) {
-        float d = sdSphere(pos - particlePositions[i], 0.2);
-        dist = smoothMinimum(dist, d, 0.5); // Blend factor
+    vec4 dist = vec4(farDistance, 0.0, 0.0, 0.0);
+    bool found = false;
+    nearestParticle = -1;
+    if (tileLast - tileFirst < gridCount) {
+        for (int j = tileFirst; j < tileLast; j++) {
+            blendParticle(dist, found, pos, texelFetch(tileParticles, j).r, withGradient);
+        }
     }
+    else {
+        for (int z = lo.z; z <= hi.z; z++) {
+            for (int y = lo.y; y <= hi.y; y++) {
+                int rowStart = (z * gridDims.y + y) * gridDims.x;
+                int first = texelFetch(cellStarts, rowStart + lo.x).r;
+                int last = texelFetch(cellStarts, rowStart + hi.x + 1).r;
+
+                for (int i = first; i < last; i++) {
+                    blendParticle(dist, found, pos, i, withGradient);
+                }
+            }
+        }
+    }
+    if (dist.x > farDistance) dist = vec4(farDistance, 0.0, 0.0, 0.0);
     return dist;
 }
 
-// Raymarching loop
-float raymarch(vec3 rayOrigin, vec3 rayDir) {
-    float t = 0.0;
+// Scene SDF — blend the particles near pos
+float map(vec3 pos) {
+    if (particleCount == 0) return 10000.0; // no particles, return large distance
+    if (useVolume) return mapVolume(pos);
+
+    return evaluateParticles(pos, false).x;
+}
+
+// Distance and density at pos - density is what one absorption step picks up there
+vec2 mapDensity(vec3 pos) {
+    if (useVolume && particleCount > 0) {
+        float boxDist = distanceToVolume(pos);
+        if (boxDist > 0.0) return vec2(boxDist + 0.5 * voxelSize, 0.0);
+        return sampleVolume(pos); // baked density already sums the falloff of every particle around pos
+    }
+
+    float d = map(pos);
+    // Treat negative or small values as high density
+    return vec2(d, max(densityBand - d, 0.0));
+}
 
-	// 100 is the maximum number of steps the ray will march
-    for (int i = 0; i < 100; i++) {
+// Entry and exit distance of the ray through the box, entry > exit if it misses
+vec2 intersectBox(vec3 rayOrigin, vec3 rayDir, vec3 boxMin, vec3 boxMax) {
+    vec3 invDir = 1.0 / rayDir;
+    vec3 t0 = (boxMin - rayOrigin) * invDir;
+    vec3 t1 = (boxMax - rayOrigin) * invDir;
+    vec3 tNear = min(t0, t1);
+    vec3 tFar = max(t0, t1);
+    return vec2(max(max(tNear.x, tNear.y), tNear.z), min(min(tFar.x, tFar.y), tFar.z));
+}
+
+// Raymarching loop, from tStart until the ray leaves the fluid bounds at tEnd
+float raymarch(vec3 rayOrigin, vec3 rayDir, float tStart, float tEnd) {
+    float t = tStart;
+
+	// MAX_MARCH_STEPS is the maximum number of steps the ray will march
+    for (int i = 0; i < MAX_MARCH_STEPS; i++) {
         vec3 pos = rayOrigin + t * rayDir;
         float dist = map(pos);
         if (dist < 0.001) break;
         t += dist;
-        if (t > 100.0) break;
+        if (t > tEnd) break;
     }
     return t;
 }
 
-float accumulateDensity(vec3 rayOrigin, vec3 rayDir) {
-    float t = 0.0;
-    float densityStep = 0.1; // Step size along the ray
-    const int maxSteps = 100;
+// Continues the march from the surface hit through the fluid, summing density for Beer-Lambert absorption
+// --> Inside the density band every step is DENSITY_STEP long; samples are weighted to the 0.1 step the sum is calibrated for
+// --> Outside it the SDF says how far the next fluid is, so the gap is skipped in one step
+// --> Stops once the fluid behind the surface is effectively opaque
+float accumulateDensity(vec3 rayOrigin, vec3 rayDir, float tStart, float tEnd) {
+    float t = tStart;
+    float densityStep = DENSITY_STEP; // Step size along the ray
     float density = 0.0;
 
-    for (int i = 0; i < maxSteps; ++i) {
-        vec3 pos = rayOrigin + rayDir * t;
-
-        float d = map(pos); // Get SDF value at current position
-
-        // Treat negative or small values as high density
-        if (d < 0.2) {
-            density += (0.2 - d); // You can tweak this to control brightness/density
-        }
+    for (int i = 0; i < MAX_DENSITY_STEPS; ++i) {
+        vec2 sampled = mapDensity(rayOrigin + rayDir * t);
+        density += sampled.y * DENSITY_SAMPLE_WEIGHT; // You can tweak this to control brightness/density
+        if (density > opaqueDensity) break;
 
-        t += densityStep;
-        if (t > 100.0) break;
+        t += max(densityStep, sampled.x - densityBand);
+        if (t > tEnd) break;
     }
 
     return density;
 }
 
+// Surface normal at p
+// --> Particles: analytic gradient from the same single pass over the nearby particles as map()
+// --> Volume: central differences, six trilinear texture fetches half a voxel apart
 vec3 estimateNormal(vec3 p) {
-    float eps = 0.001;
-    vec2 h = vec2(eps, 0.0);
-    return normalize(vec3(
-        map(p + h.xyy) - map(p - h.xyy),
-        map(p + h.yxy) - map(p - h.yxy),
-        map(p + h.yyx) - map(p - h.yyx)
-    ));
+    if (useVolume) {
+        vec2 h = vec2(0.5 * voxelSize, 0.0);
+        return normalize(vec3(
+            sampleVolume(p + h.xyy).x - sampleVolume(p - h.xyy).x,
+            sampleVolume(p + h.yxy).x - sampleVolume(p - h.yxy).x,
+            sampleVolume(p + h.yyx).x - sampleVolume(p - h.yyx).x
+        ));
+    }
+    return normalize(evaluateParticles(p, true).yzw);
+}
+
+// How far the surface at the point estimateNormal() was last called with moved over the last frame
+// --> The baked volume keeps no particle identity, so it reports a still surface - the Renderer never reprojects volume frames
+vec3 surfaceMotion() {
+    if (useVolume || nearestParticle < 0) return vec3(0.0);
+    return texelFetch(particleMotion, nearestParticle).xyz;
+}
+
+// Finds what this pixel sees by following its surface back into last frame's targets, false if it has to be marched
+// --> (1) Last frame's hit distance at this pixel, moved along last frame's motion, is a guess at where the surface came from
+// --> (2) The previous pixel that saw the guess holds the real previous hit, which is moved forward by its motion
+// --> (3) The moved hit is only accepted if it lies on this ray and on the current surface, within a few pixel footprints
+bool reproject(vec3 rayOrigin, vec3 rayDir, out vec4 color, out vec4 geometry, out vec4 motion) {
+    ivec2 pixel = ivec2(gl_FragCoord.xy);
+    float guessT = texelFetch(historyGeometry, pixel, 0).w;
+    if (guessT <= 0.0) return false; // missed last frame - no depth to start from
+    vec3 guess = rayOrigin + guessT * rayDir - texelFetch(historyMotion, pixel, 0).xyz;
+
+    vec4 clip = previousViewProjection * vec4(guess, 1.0);
+    if (clip.w <= 0.0) return false;
+    vec2 uv = clip.xy / clip.w * 0.5 + 0.5;
+    if (any(lessThan(uv, vec2(0.0))) || any(greaterThanEqual(uv, vec2(1.0)))) return false;
+    ivec2 previousPixel = ivec2(uv * iResolution);
+
+    geometry = texelFetch(historyGeometry, previousPixel, 0);
+    if (geometry.w <= 0.0) return false;
+    color = texelFetch(historyColor, previousPixel, 0);
+    motion = texelFetch(historyMotion, previousPixel, 0);
+
+    // Surfaces keep last frame's velocity for one more frame
+    vec3 previousHit = previousCameraPosition + geometry.w * normalize(guess - previousCameraPosition);
+    vec3 hit = previousHit + motion.xyz;
+    float t = dot(hit - rayOrigin, rayDir);
+    if (t <= 0.0) return false;
+
+    // A few pixels' worth of slack at this distance, plus a little for the surface moving differently than last frame
+    float tolerance = 3.0 * t * 2.0 * tan(radians(22.5)) / iResolution.y + 0.02;
+    if (length(hit - (rayOrigin + t * rayDir)) > tolerance) return false;
+    if (abs(map(rayOrigin + t * rayDir)) > tolerance) return false;
+
+    geometry.w = t;
+    return true;
 }
 
 /*
@@ -110,24 +378,20 @@ vec3 normalColor = normal * 0.5 + 0.5; // convert from [-1,1] to [0,1]
 fragColor = vec4(normalColor, 1.0);
 */
 
-vec3 getColor(vec3 rayOrigin, vec3 rayDir, float t) {
+vec3 getColor(vec3 rayOrigin, vec3 rayDir, float t, vec3 normal) {
     float ambient_strength = 0.6;
     float diffuse_strength = 0.4;
 
-    vec3 u_lightColor = vec3(1.0f, 1.0f, 1.0f); // Should also be passed in
-
     // Calculations for ambient lighting
-    vec3 ambient = ambient_strength * u_lightColor;
+    vec3 ambient = ambient_strength * i_lightColor;
 
-    // Calculations for diffuse lighting 
+    // Calculations for diffuse lighting - the scene light, dimmed by the fluid between the hit and the light
     vec3 hitPos = rayOrigin + t * rayDir;
-    vec3 normal = estimateNormal(hitPos);
 
 	vec3 normals  = normalize(normal); // Currently important to visualize normals too
-    vec3 u_lightPosition = vec3(3000000.0,4.0,50.0);
-    vec3 lightDir = normalize(u_lightPosition - hitPos);  
+    vec3 lightDir = normalize(i_lightPosition - hitPos);  
     float diff = max(dot(normals, lightDir), 0.0);
-    vec3 diffuse = diffuse_strength * diff * u_lightColor;
+    vec3 diffuse = diffuse_strength * diff * sampleLightTransmittance(hitPos) * i_lightColor;
 
     vec3 baseColor = vec3(0.0, 0.5, 0.8);
     vec3 lightColor_x_objectColor = (ambient + diffuse) * baseColor;
@@ -141,34 +405,62 @@ void main()
     vec2 screenPos = vUV * 2.0 - 1.0; // converting the vertex position coordinates from a range of [0,1] to [-1, 1]
     screenPos.x *= iResolution.x / iResolution.y; // fixes distortion 
 
-    vec3 rayOrigin = cameraPosition;
+    vec3 rayOrigin = i_viewPos;
     
     float fov = radians(45.0);
     float focalLength = 1.0 / tan(fov * 0.5);
+    // Rays use the same view as the rasterized passes (and the tile culling): camera space -> world space
+    mat3 cameraRotation = transpose(mat3(u_ViewMatrix));
     vec3 rayDir = normalize(cameraRotation * vec3(screenPos.x, screenPos.y, -focalLength));
 
 
-    float t = raymarch(rayOrigin, rayDir);
+    // Rays that miss the fluid bounds cost nothing
+    vec2 span = intersectBox(rayOrigin, rayDir, fluidBoundsMin, fluidBoundsMax);
+    float tStart = max(span.x, 0.0);
+    float tEnd = min(span.y, maxDistance);
+    if (tStart > tEnd) discard;
+
+    if (!useVolume) {
+        // Nothing reaches into this tile, so there is nothing to hit
+        ivec2 tile = ivec2(gl_FragCoord.xy) / tileSize;
+        int tileIndex = tile.y * tileCounts.x + tile.x;
+        tileFirst = texelFetch(tileStarts, tileIndex).r;
+        tileLast = texelFetch(tileStarts, tileIndex + 1).r;
+        if (tileFirst == tileLast) discard;
+    }
+
+    // Phases alternate per 8x8 block rather than per pixel, so neighbouring fragments run the same branch
+    ivec2 block = ivec2(gl_FragCoord.xy) / temporalBlockSize;
+    if (temporalMode && ((block.x & 1) | ((block.y & 1) << 1)) != temporalPhase) {
+        vec4 color, geometry, motion;
+        if (reproject(rayOrigin, rayDir, color, geometry, motion)) {
+            fragColor = color;
+            fragGeometry = geometry;
+            fragMotion = motion;
+            return;
+        }
+    }
+
+    float t = raymarch(rayOrigin, rayDir, tStart, tEnd);
 
-    if (t < 100.0) {
+    if (t < tEnd) {
         // Hit something — use gradient color
         vec3 baseColor = vec3(0.0, 0.5, 0.8); // blue-green
         vec3 white = vec3(1.0);
         vec3 finalColor = mix(baseColor, white, vUV.y);
-        
-        vec3 hitPos = rayOrigin + t * rayDir;
-        vec3 normal = estimateNormal(hitPos);
 
-        vec3 combinedColor = getColor(rayOrigin, rayDir, t);
+        vec3 normal = estimateNormal(rayOrigin + t * rayDir);
+        vec3 combinedColor = getColor(rayOrigin, rayDir, t, normal);
 
-        float density = accumulateDensity(rayOrigin, rayDir);
-        float absorption = 0.1; // You can try values like 0.5, 1.0, 2.0 to control how strong the absorption is
+        float density = accumulateDensity(rayOrigin, rayDir, t, tEnd);
         float transmission = exp(-absorption * density);
 
         vec3 lightColor = vec3(1.0); // White light
         vec3 color = combinedColor * transmission; // Apply Beer-Lambert attenuation
 
         fragColor = vec4(color, 1.0);
+        fragGeometry = vec4(normal, t);
+        fragMotion = vec4(surfaceMotion(), 0.0);
     } else {
         // Background
         discard;
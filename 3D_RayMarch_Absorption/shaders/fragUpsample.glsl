@@ -0,0 +1,61 @@
+#version 410 core
+
+in vec2 vUV;
+out vec4 fragColor;
+
+// Ray-march output rendered below screen resolution
+uniform sampler2D rayMarchColor;
+uniform sampler2D rayMarchGeometry; // xyz = normal, w = hit distance (0 where the ray missed)
+
+const float depthSigma = 0.02; // hit distance difference (relative to the reference) at which a neighbour's weight drops to 1/e
+const float normalPower = 8.0; // how sharply normals that disagree are rejected
+
+// Bilateral upsample
+// --> Starts from the plain bilinear weights of the four nearest low-resolution texels
+// --> The front-most covered texel is the reference: neighbours on another surface (different hit distance)
+//     or around a crease (different normal) are weighted down, so silhouettes and creases stay sharp
+// --> Pixels where less than half of the bilinear footprint hit fluid stay background
+void main()
+{
+    ivec2 lowSize = textureSize(rayMarchColor, 0);
+    vec2 p = vUV * vec2(lowSize) - 0.5;
+    ivec2 base = ivec2(floor(p));
+    vec2 f = p - vec2(base);
+
+    vec4 colors[4];
+    vec4 geometry[4];
+    float bilinear[4];
+    float tRef = 1e30;
+    vec3 nRef = vec3(0.0);
+    float coverage = 0.0;
+    for (int i = 0; i < 4; i++) {
+        ivec2 offset = ivec2(i & 1, i >> 1);
+        ivec2 texel = clamp(base + offset, ivec2(0), lowSize - 1);
+        colors[i] = texelFetch(rayMarchColor, texel, 0);
+        geometry[i] = texelFetch(rayMarchGeometry, texel, 0);
+        bilinear[i] = (offset.x == 1 ? f.x : 1.0 - f.x) * (offset.y == 1 ? f.y : 1.0 - f.y);
+
+        if (geometry[i].w > 0.0) {
+            coverage += bilinear[i];
+            if (geometry[i].w < tRef) {
+                tRef = geometry[i].w;
+                nRef = geometry[i].xyz;
+            }
+        }
+    }
+    if (coverage < 0.5) discard;
+
+    vec3 color = vec3(0.0);
+    float totalWeight = 0.0;
+    for (int i = 0; i < 4; i++) {
+        if (geometry[i].w <= 0.0) continue;
+
+        float depthWeight = exp(-abs(geometry[i].w - tRef) / (depthSigma * tRef));
+        float normalWeight = pow(max(dot(geometry[i].xyz, nRef), 0.0), normalPower);
+        float weight = max(bilinear[i], 1e-3) * depthWeight * normalWeight;
+        color += weight * colors[i].rgb;
+        totalWeight += weight;
+    }
+
+    fragColor = vec4(color / totalWeight, 1.0);
+}
@@ -0,0 +1,56 @@
+#version 410 core
+// One camera-facing quad per particle, instanced
+// --> The quad lies in the plane through the sphere's center perpendicular to the eye -> center direction,
+//     sized to the cross-section of the cone of rays that touch the sphere, so it covers the exact silhouette
+layout(location=0) in vec2 corner; // quad corner in [-1, 1]
+// Per instance (one sphere per particle): xyz = center, w = radius
+layout(location=3) in vec4 instanceParticle;
+uniform float radiusPadding; // 0 draws the particle's sphere - the screen-space fluid thickness pass splats it grown by the density band
+
+// Uniform variables - the same inputs as vertPhong.glsl
+// Per-frame camera, projection and light, shared by every program (Renderer::FrameState)
+layout(std140) uniform FrameState {
+  mat4 u_ViewMatrix;
+  mat4 u_Projection;
+  vec3 i_viewPos;
+  vec3 i_lightColor;
+  vec3 i_lightPosition;
+};
+
+out vec3 FragPos; // point on the quad, the ray through it is intersected with the sphere
+out vec3 sphereCenter;
+out float sphereRadius;
+out vec3 u_lightColor;
+out vec3 u_lightPosition;
+out vec3 u_viewPos;
+
+void main()
+{
+  u_lightColor = i_lightColor;
+  u_lightPosition = i_lightPosition;
+  u_viewPos = i_viewPos;
+
+  sphereCenter = instanceParticle.xyz;
+  sphereRadius = instanceParticle.w + radiusPadding;
+
+  vec3 toCenter = sphereCenter - i_viewPos;
+  float distance = length(toCenter);
+  if (distance <= sphereRadius) {
+    // Eye inside the sphere - nothing sensible to draw, collapse the quad
+    gl_Position = vec4(0.0, 0.0, 0.0, 1.0);
+    FragPos = sphereCenter;
+    return;
+  }
+
+  // Basis of the quad plane, kept upright with the camera's up axis (row 1 of the view matrix)
+  vec3 axis = toCenter / distance;
+  vec3 cameraUp = vec3(u_ViewMatrix[0][1], u_ViewMatrix[1][1], u_ViewMatrix[2][1]);
+  vec3 right = normalize(cross(axis, cameraUp));
+  vec3 up = cross(right, axis);
+
+  // Radius of the tangent cone where it crosses the plane: distance * tan(asin(r / distance))
+  float halfSize = sphereRadius * distance / sqrt(distance * distance - sphereRadius * sphereRadius);
+
+  FragPos = sphereCenter + halfSize * (corner.x * right + corner.y * up);
+  gl_Position = u_Projection * u_ViewMatrix * vec4(FragPos, 1.0f);
+}
@@ -3,8 +3,14 @@ layout(location=0) in vec3 position;
 
 // Uniform variables
 uniform mat4 u_ModelMatrix;
-uniform mat4 u_ViewMatrix;
-uniform mat4 u_Projection;
+// Per-frame camera, projection and light, shared by every program (Renderer::FrameState)
+layout(std140) uniform FrameState {
+  mat4 u_ViewMatrix;
+  mat4 u_Projection;
+  vec3 i_viewPos;
+  vec3 i_lightColor;
+  vec3 i_lightPosition;
+};
 
 void main()
 {
@@ -6,14 +6,18 @@
 layout(location=0) in vec3 position;
 layout(location=1) in vec3 vertexColors;
 layout(location=2) in vec3 vertexNormals;
+// Per instance (one sphere per particle): xyz = center, w = radius
+layout(location=3) in vec4 instanceParticle;
 
 // Uniform variables
-uniform mat4 u_ModelMatrix;
-uniform mat4 u_ViewMatrix;
-uniform mat4 u_Projection; // We'll use a perspective projection
-uniform vec3 i_lightColor;
-uniform vec3 i_lightPosition;
-uniform vec3 i_viewPos;
+// Per-frame camera, projection and light, shared by every program (Renderer::FrameState)
+layout(std140) uniform FrameState {
+  mat4 u_ViewMatrix;
+  mat4 u_Projection;
+  vec3 i_viewPos;
+  vec3 i_lightColor;
+  vec3 i_lightPosition;
+};
 
 // Pass vertex colors into the fragment shader
 out vec3 v_vertexColors;
@@ -32,9 +36,12 @@ void main()
   u_lightPosition = i_lightPosition;
   u_viewPos = i_viewPos;
   
-  vec4 newPosition = u_Projection * u_ViewMatrix * u_ModelMatrix * vec4(position,1.0f);
+  // Uniform scale + translate, so the mesh normals need no transform
+  vec3 worldPosition = instanceParticle.xyz + instanceParticle.w * position;
 
-  FragPos = vec3(u_ModelMatrix * vec4(position, 1.0));
+  vec4 newPosition = u_Projection * u_ViewMatrix * vec4(worldPosition,1.0f);
+
+  FragPos = worldPosition;
   
   gl_Position = vec4(newPosition.x, newPosition.y, newPosition.z, newPosition.w);
 }
@@ -0,0 +1,358 @@
+#include "CpuRayMarcher.hpp"
+
+// Shader constants (fragRayMarch.glsl)
+static const float maxDistance = 100.0f;
+static const float densityBand = ParticleVolume::DENSITY_BAND;
+static const float absorption = LightTransmittance::ABSORPTION; // the Renderer defines the shader's ABSORPTION from the same constant
+static const float opaqueDensity = 5.5f / absorption;
+static const float densityStep = LightTransmittance::DENSITY_STEP;
+static const glm::vec3 baseColor = glm::vec3(0.0f, 0.5f, 0.8f);
+
+CpuRayMarcher::CpuRayMarcher(){
+    numThreads = std::max(1u, std::thread::hardware_concurrency());
+    blendFactor = 0.5f;
+    rayOrigin = glm::vec3(0.0f);
+    cameraRotation = glm::mat3(1.0f);
+    lightPosition = glm::vec3(0.0f);
+    fluidBoundsMin = glm::vec3(0.0f);
+    fluidBoundsMax = glm::vec3(0.0f);
+    nextTile = 0;
+    incremental = false;
+    moveTolerance = 0.005f; // about a third of a pixel 10 units in front of the camera at 480 pixels high
+    historyValid = false;
+    historyView = glm::mat4(1.0f);
+    historyLightPosition = glm::vec3(0.0f);
+    marchedTiles = 0;
+    setResolution(640, 480);
+}
+
+void CpuRayMarcher::setResolution(int i_width, int i_height){
+    width = std::max(1, i_width);
+    height = std::max(1, i_height);
+    projection = glm::perspective(glm::radians(45.0f), (float)width / (float)height, 0.1f, 10000.0f);
+    pixels.assign((size_t)width * height * 4, 0);
+    historyValid = false;
+}
+
+void CpuRayMarcher::setIncremental(bool enabled){
+    incremental = enabled;
+    historyValid = false;
+}
+
+void CpuRayMarcher::setMoveTolerance(float distance){
+    moveTolerance = distance;
+}
+
+int CpuRayMarcher::getMarchedTileCount(){
+    return marchedTiles;
+}
+
+const std::vector<unsigned char>& CpuRayMarcher::getPixels(){
+    return pixels;
+}
+
+void CpuRayMarcher::SaveFrame(const std::string& path){
+    WritePPM(path, width, height, pixels.data());
+}
+
+void CpuRayMarcher::Render(ParticleSpan<glm::vec3> positions, ParticleSpan<float> radii, ParticleSpan<uint8_t> flags,
+                           const glm::mat4& view, const glm::vec3& viewPosition, const glm::vec3& i_lightPosition){
+    marchedTiles = 0;
+    particleGrid.Build(positions, radii, flags, blendFactor);
+    if (particleGrid.getParticleCount() == 0) {
+        std::fill(pixels.begin(), pixels.end(), 0);
+        historyValid = false;
+        return;
+    }
+
+    // Every ray changes with the camera, and every hit's shading with the light, so then nothing from the last frame can be kept
+    if (!incremental || view != historyView || i_lightPosition != historyLightPosition) {
+        std::fill(pixels.begin(), pixels.end(), 0);
+        historyValid = false;
+    }
+
+    // Same bounds and tile inflation as Renderer::PreDraw_RM()
+    float fluidPadding = particleGrid.getMaxRadius() + std::max(blendFactor, densityBand);
+    fluidBoundsMin = particleGrid.getBoundsMin() - glm::vec3(fluidPadding);
+    fluidBoundsMax = particleGrid.getBoundsMax() + glm::vec3(fluidPadding);
+    tileCuller.Build(particleGrid.getSortedParticles(), view, projection, width, height, std::max(blendFactor, densityBand));
+
+    rayOrigin = viewPosition;
+    cameraRotation = glm::transpose(glm::mat3(view));
+    lightPosition = i_lightPosition;
+    glm::ivec2 tileCounts = tileCuller.getTileCounts();
+    tileHistory.resize(tileCounts.x * tileCounts.y);
+
+    // Tiles are taken one at a time, so threads that draw empty tiles simply take more of them
+    nextTile = 0;
+    std::vector<std::thread> threads;
+    for (int t = 0; t < numThreads; ++t) {
+        threads.emplace_back(&CpuRayMarcher::RenderTilesThread, this);
+    }
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+
+    historyValid = incremental;
+    historyView = view;
+    historyLightPosition = i_lightPosition;
+}
+
+void CpuRayMarcher::RenderTilesThread(){
+    glm::ivec2 tileCounts = tileCuller.getTileCounts();
+    int numTiles = tileCounts.x * tileCounts.y;
+    for (int tile = nextTile++; tile < numTiles; tile = nextTile++) {
+        RenderTile(tile);
+    }
+}
+
+void CpuRayMarcher::RenderTile(int tileIndex){
+    const std::vector<int>& tileStarts = tileCuller.getTileStarts();
+    int tileFirst = tileStarts[tileIndex];
+    int tileLast = tileStarts[tileIndex + 1];
+    if (incremental && !UpdateTileHistory(tileIndex, tileFirst, tileLast)) return; // still showing what it would show now
+
+    glm::ivec2 tileCounts = tileCuller.getTileCounts();
+    int x0 = (tileIndex % tileCounts.x) * TILE_SIZE;
+    int y0 = (tileIndex / tileCounts.x) * TILE_SIZE;
+    int x1 = std::min(x0 + TILE_SIZE, width);
+    int y1 = std::min(y0 + TILE_SIZE, height);
+
+    if (historyValid) {
+        // Only this tile's pixels are about to be replaced - the rest of the frame is kept
+        for (int y = y0; y < y1; y++) {
+            std::fill(&pixels[((size_t)y * width + x0) * 4], &pixels[((size_t)y * width + x1) * 4], 0);
+        }
+    }
+    if (tileFirst == tileLast) return; // nothing reaches into this tile, so there is nothing to hit
+    marchedTiles++;
+
+    for (int y = y0; y < y1; y++) {
+        for (int x = x0; x < x1; x += Float8::LANES) {
+            RenderPacket(x, y, std::min(Float8::LANES, x1 - x), tileFirst, tileLast);
+        }
+    }
+}
+
+bool CpuRayMarcher::UpdateTileHistory(int tileIndex, int tileFirst, int tileLast){
+    const std::vector<int>& tileParticles = tileCuller.getTileParticles();
+    const std::vector<int>& sortedSource = particleGrid.getSortedSource();
+    const std::vector<glm::vec4>& particles = particleGrid.getSortedParticles();
+    TileHistory& history = tileHistory[tileIndex];
+
+    // Unchanged if the same particles (in the same order) reach the tile and none has moved past the tolerance
+    int count = tileLast - tileFirst;
+    bool changed = !historyValid || (int)history.sources.size() != count;
+    float toleranceSquared = moveTolerance * moveTolerance;
+    for (int j = 0; j < count && !changed; j++) {
+        int index = tileParticles[tileFirst + j];
+        const glm::vec4& particle = particles[index];
+        const glm::vec4& marched = history.particles[j];
+        glm::vec3 moved = glm::vec3(particle) - glm::vec3(marched);
+        changed = sortedSource[index] != history.sources[j] || glm::dot(moved, moved) > toleranceSquared || particle.w != marched.w;
+    }
+    if (!changed) return false;
+
+    history.sources.resize(count);
+    history.particles.resize(count);
+    for (int j = 0; j < count; j++) {
+        int index = tileParticles[tileFirst + j];
+        history.sources[j] = sortedSource[index];
+        history.particles[j] = particles[index];
+    }
+    return true;
+}
+
+void CpuRayMarcher::RenderPacket(int x, int y, int laneCount, int tileFirst, int tileLast){
+    float aspect = (float)width / (float)height;
+    float focalLength = 1.0f / std::tan(glm::radians(45.0f) * 0.5f);
+
+    // (1) One ray per lane through its pixel center, clipped to the fluid bounds
+    float laneDir[3][Float8::LANES] = {};
+    float laneStart[Float8::LANES] = {};
+    float laneEnd[Float8::LANES] = {};
+    int live = 0;
+    for (int lane = 0; lane < laneCount; lane++) {
+        glm::vec2 uv((x + lane + 0.5f) / width, (y + 0.5f) / height);
+        glm::vec2 screenPos = uv * 2.0f - 1.0f;
+        screenPos.x *= aspect;
+        glm::vec3 rayDir = glm::normalize(cameraRotation * glm::vec3(screenPos, -focalLength));
+
+        glm::vec3 invDir = 1.0f / rayDir;
+        glm::vec3 t0 = (fluidBoundsMin - rayOrigin) * invDir;
+        glm::vec3 t1 = (fluidBoundsMax - rayOrigin) * invDir;
+        glm::vec3 tNear = glm::min(t0, t1);
+        glm::vec3 tFar = glm::max(t0, t1);
+        float tStart = std::max(std::max(std::max(tNear.x, tNear.y), tNear.z), 0.0f);
+        float tEnd = std::min(std::min(std::min(tFar.x, tFar.y), tFar.z), maxDistance);
+        if (tStart > tEnd) continue;
+
+        for (int axis = 0; axis < 3; axis++) {
+            laneDir[axis][lane] = rayDir[axis];
+        }
+        laneStart[lane] = tStart;
+        laneEnd[lane] = tEnd;
+        live |= 1 << lane;
+    }
+    if (live == 0) return;
+
+    Float8 origin[3] = {Float8(rayOrigin.x), Float8(rayOrigin.y), Float8(rayOrigin.z)};
+    Float8 dir[3] = {Float8::Load(laneDir[0]), Float8::Load(laneDir[1]), Float8::Load(laneDir[2])};
+    Float8 tEnd = Float8::Load(laneEnd);
+    Float8 pos[3];
+
+    // (2) Sphere trace - raymarch(); lanes drop out as they hit or leave the bounds
+    Float8 t = Float8::Load(laneStart);
+    int marching = live;
+    for (int i = 0; i < MAX_STEPS && marching != 0; i++) {
+        for (int axis = 0; axis < 3; axis++) pos[axis] = origin[axis] + t * dir[axis];
+        Float8 dist = EvaluatePacket(pos, marching, tileFirst, tileLast, nullptr);
+        marching &= ~(dist < Float8(0.001f));
+        t = Float8::Select(marching, t + dist, t);
+        marching &= ~(t > tEnd);
+    }
+    int hit = live & (t < tEnd);
+    if (hit == 0) return;
+
+    // (3) Normal from the blended gradient, then getColor()
+    Float8 gradient[3];
+    for (int axis = 0; axis < 3; axis++) pos[axis] = origin[axis] + t * dir[axis];
+    EvaluatePacket(pos, hit, tileFirst, tileLast, gradient);
+    Float8 gradientLength = max(sqrt(gradient[0] * gradient[0] + gradient[1] * gradient[1] + gradient[2] * gradient[2]), Float8(1e-20f));
+    Float8 toLight[3];
+    for (int axis = 0; axis < 3; axis++) toLight[axis] = Float8(lightPosition[axis]) - pos[axis];
+    Float8 toLightLength = sqrt(toLight[0] * toLight[0] + toLight[1] * toLight[1] + toLight[2] * toLight[2]);
+    Float8 diffuse = max((gradient[0] * toLight[0] + gradient[1] * toLight[1] + gradient[2] * toLight[2]) / (gradientLength * toLightLength), Float8(0.0f));
+    Float8 lighting = Float8(0.6f) + Float8(0.4f) * diffuse;
+
+    // (4) accumulateDensity() - fixed steps inside the density band, SDF skips across the gaps
+    Float8 density(0.0f);
+    marching = hit;
+    for (int i = 0; i < MAX_STEPS && marching != 0; i++) {
+        for (int axis = 0; axis < 3; axis++) pos[axis] = origin[axis] + t * dir[axis];
+        Float8 dist = EvaluatePacket(pos, marching, tileFirst, tileLast, nullptr);
+        density = Float8::Select(marching, density + max(Float8(densityBand) - dist, Float8(0.0f)), density);
+        marching &= ~(density > Float8(opaqueDensity));
+        t = Float8::Select(marching, t + max(Float8(densityStep), dist - Float8(densityBand)), t);
+        marching &= ~(t > tEnd);
+    }
+
+    // (5) Beer-Lambert attenuation, stored the way GL converts to RGBA8
+    for (int lane = 0; lane < laneCount; lane++) {
+        if ((hit & (1 << lane)) == 0) continue;
+        glm::vec3 color = lighting[lane] * baseColor * std::exp(-absorption * density[lane]);
+        unsigned char* pixel = &pixels[((size_t)y * width + x + lane) * 4];
+        for (int c = 0; c < 3; c++) {
+            pixel[c] = (unsigned char)(glm::clamp(color[c], 0.0f, 1.0f) * 255.0f + 0.5f);
+        }
+        pixel[3] = 255;
+    }
+}
+
+Float8 CpuRayMarcher::EvaluatePacket(const Float8 pos[3], int laneMask, int tileFirst, int tileLast, Float8* gradient){
+    glm::vec3 gridOrigin = particleGrid.getOrigin();
+    glm::ivec3 gridDims = particleGrid.getDims();
+    float cellSize = particleGrid.getCellSize();
+    float farDistance = cellSize - particleGrid.getMaxRadius() - 0.25f * blendFactor;
+    glm::vec3 gridMax = gridOrigin + glm::vec3(gridDims) * cellSize;
+
+    // Lanes outside the grid step straight towards it
+    Float8 outsideDist[3];
+    for (int axis = 0; axis < 3; axis++) {
+        outsideDist[axis] = max(max(Float8(gridOrigin[axis]) - pos[axis], pos[axis] - Float8(gridMax[axis])), Float8(0.0f));
+    }
+    Float8 boxDist = sqrt(outsideDist[0] * outsideDist[0] + outsideDist[1] * outsideDist[1] + outsideDist[2] * outsideDist[2]);
+    int outside = laneMask & (boxDist > Float8(0.0f));
+    int inside = laneMask & ~outside;
+
+    Float8 dist(farDistance);
+    if (gradient != nullptr) {
+        gradient[0] = gradient[1] = gradient[2] = Float8(0.0f);
+    }
+
+    if (inside != 0) {
+        // The 3x3x3 cells around every inside lane - neighbouring rays are close, so this is rarely more than a few cells wider
+        float lanePos[3][Float8::LANES];
+        for (int axis = 0; axis < 3; axis++) pos[axis].Store(lanePos[axis]);
+        glm::ivec3 lo(gridDims);
+        glm::ivec3 hi(-1);
+        for (int lane = 0; lane < Float8::LANES; lane++) {
+            if ((inside & (1 << lane)) == 0) continue;
+            glm::vec3 p(lanePos[0][lane], lanePos[1][lane], lanePos[2][lane]);
+            glm::ivec3 cell = glm::clamp(glm::ivec3(glm::floor((p - gridOrigin) / cellSize)), glm::ivec3(0), gridDims - 1);
+            lo = glm::min(lo, cell - 1);
+            hi = glm::max(hi, cell + 1);
+        }
+        lo = glm::max(lo, glm::ivec3(0));
+        hi = glm::min(hi, gridDims - 1);
+
+        const std::vector<int>& cellStarts = particleGrid.getCellStarts();
+        int gridCount = 0;
+        for (int z = lo.z; z <= hi.z; z++) {
+            for (int y = lo.y; y <= hi.y; y++) {
+                int rowStart = (z * gridDims.y + y) * gridDims.x;
+                gridCount += cellStarts[rowStart + hi.x + 1] - cellStarts[rowStart + lo.x];
+            }
+        }
+
+        // Smooth-min one particle into all lanes at once - blendParticle()
+        const std::vector<glm::vec4>& particles = particleGrid.getSortedParticles();
+        const Float8 halfInvBlend(0.5f / blendFactor);
+        const Float8 blend(blendFactor);
+        bool found = false;
+        auto blendParticle = [&](int index) {
+            const glm::vec4& particle = particles[index];
+            Float8 toPos[3] = {pos[0] - Float8(particle.x), pos[1] - Float8(particle.y), pos[2] - Float8(particle.z)};
+            Float8 length = sqrt(toPos[0] * toPos[0] + toPos[1] * toPos[1] + toPos[2] * toPos[2]);
+            Float8 d = length - Float8(particle.w);
+            if (!found) {
+                dist = d;
+                if (gradient != nullptr) {
+                    Float8 invLength = Float8(1.0f) / max(length, Float8(1e-6f));
+                    for (int axis = 0; axis < 3; axis++) gradient[axis] = toPos[axis] * invLength;
+                }
+                found = true;
+                return;
+            }
+            Float8 weight = clamp(Float8(0.5f) + (d - dist) * halfInvBlend, Float8(0.0f), Float8(1.0f));
+            if (gradient != nullptr) {
+                Float8 invLength = Float8(1.0f) / max(length, Float8(1e-6f));
+                for (int axis = 0; axis < 3; axis++) gradient[axis] = mix(toPos[axis] * invLength, gradient[axis], weight);
+            }
+            dist = mix(d, dist, weight) - blend * weight * (Float8(1.0f) - weight);
+        };
+
+        if (tileLast - tileFirst < gridCount) {
+            const std::vector<int>& tileParticles = tileCuller.getTileParticles();
+            for (int j = tileFirst; j < tileLast; j++) {
+                blendParticle(tileParticles[j]);
+            }
+        }
+        else {
+            for (int z = lo.z; z <= hi.z; z++) {
+                for (int y = lo.y; y <= hi.y; y++) {
+                    int rowStart = (z * gridDims.y + y) * gridDims.x;
+                    int first = cellStarts[rowStart + lo.x];
+                    int last = cellStarts[rowStart + hi.x + 1];
+                    for (int i = first; i < last; i++) {
+                        blendParticle(i);
+                    }
+                }
+            }
+        }
+
+        int beyond = dist > Float8(farDistance);
+        dist = Float8::Select(beyond, Float8(farDistance), dist);
+        if (gradient != nullptr) {
+            for (int axis = 0; axis < 3; axis++) gradient[axis] = Float8::Select(beyond, Float8(0.0f), gradient[axis]);
+        }
+    }
+
+    if (outside != 0) {
+        dist = Float8::Select(outside, boxDist + Float8(farDistance), dist);
+        if (gradient != nullptr) {
+            for (int axis = 0; axis < 3; axis++) gradient[axis] = Float8::Select(outside, Float8(0.0f), gradient[axis]);
+        }
+    }
+    return dist;
+}
@@ -0,0 +1,184 @@
+#include "CpuSplatRenderer.hpp"
+
+// Impostor lighting (fragImpostor.glsl), white light on the particle mesh blue - only the blue channel is ever lit
+static const float ambientStrength = 0.1f;
+static const float diffuseStrength = 0.4f;
+static const float specularStrength = 0.5f;
+static const float nearPlane = 0.1f;
+
+CpuSplatRenderer::CpuSplatRenderer(){
+    numThreads = std::max(1u, std::thread::hardware_concurrency());
+    view = glm::mat4(1.0f);
+    lightPosition = glm::vec3(0.0f);
+    nextTile = 0;
+    setResolution(640, 480);
+}
+
+void CpuSplatRenderer::setResolution(int i_width, int i_height){
+    width = std::max(1, i_width);
+    height = std::max(1, i_height);
+    projection = glm::perspective(glm::radians(45.0f), (float)width / (float)height, nearPlane, 10000.0f);
+    pixels.assign((size_t)width * height * 4, 0);
+}
+
+const std::vector<unsigned char>& CpuSplatRenderer::getPixels(){
+    return pixels;
+}
+
+void CpuSplatRenderer::SaveFrame(const std::string& path){
+    WritePPM(path, width, height, pixels.data());
+}
+
+void CpuSplatRenderer::Render(ParticleSpan<glm::vec3> positions, ParticleSpan<float> radii, ParticleSpan<uint8_t> flags,
+                              const glm::mat4& i_view, const glm::vec3& i_lightPosition){
+    view = i_view;
+    lightPosition = i_lightPosition;
+
+    particles.clear();
+    for (size_t i = 0; i < positions.size(); i++) {
+        if (flags[i] & PARTICLE_FLAG_ACTIVE) {
+            particles.push_back(glm::vec4(positions[i], radii[i]));
+        }
+    }
+    if (particles.empty()) {
+        std::fill(pixels.begin(), pixels.end(), 0);
+        return;
+    }
+
+    // (1) Project every particle, in parallel
+    int n = particles.size();
+    splats.resize(n);
+    int particlesPerThread = (n + numThreads - 1) / numThreads; // ceiling division
+    std::vector<std::thread> threads;
+    for (int t = 0; t < numThreads; ++t) {
+        int start = t * particlesPerThread;
+        int end = std::min(start + particlesPerThread, n);
+        if (start >= end) break;
+        threads.emplace_back(&CpuSplatRenderer::ProjectThread, this, start, end);
+    }
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+
+    // (2) Bin into screen tiles - a particle's list order is its draw order, so ties in depth resolve the same way every frame
+    tileCuller.Build(particles, view, projection, width, height, 0.0f);
+
+    // (3) Rasterize tile by tile
+    nextTile = 0;
+    threads.clear();
+    for (int t = 0; t < numThreads; ++t) {
+        threads.emplace_back(&CpuSplatRenderer::RenderTilesThread, this);
+    }
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+}
+
+void CpuSplatRenderer::ProjectThread(int startIdx, int endIdx){
+    float projectionX = projection[0][0];
+    float projectionY = projection[1][1];
+    glm::vec3 lightView = glm::vec3(view * glm::vec4(lightPosition, 1.0f));
+
+    for (int i = startIdx; i < endIdx; i++) {
+        const glm::vec4& particle = particles[i];
+        Splat& splat = splats[i];
+        glm::vec3 center = glm::vec3(view * glm::vec4(glm::vec3(particle), 1.0f));
+        splat.depth = -center.z;
+        splat.worldRadius = particle.w;
+        if (splat.depth - particle.w <= nearPlane) {
+            splat.radius = 0.0f; // reaches behind the near plane - left out of the preview
+            continue;
+        }
+
+        glm::vec2 ndc = glm::vec2(projectionX * center.x, projectionY * center.y) / splat.depth;
+        splat.center = (ndc * 0.5f + 0.5f) * glm::vec2(width, height);
+        splat.radius = particle.w * projectionY * 0.5f * height / splat.depth;
+        splat.lightDir = glm::normalize(lightView - center);
+    }
+}
+
+void CpuSplatRenderer::RenderTilesThread(){
+    glm::ivec2 tileCounts = tileCuller.getTileCounts();
+    int numTiles = tileCounts.x * tileCounts.y;
+    for (int tile = nextTile++; tile < numTiles; tile = nextTile++) {
+        RenderTile(tile);
+    }
+}
+
+void CpuSplatRenderer::RenderTile(int tileIndex){
+    glm::ivec2 tileCounts = tileCuller.getTileCounts();
+    int x0 = (tileIndex % tileCounts.x) * TILE_SIZE;
+    int y0 = (tileIndex / tileCounts.x) * TILE_SIZE;
+    int x1 = std::min(x0 + TILE_SIZE, width);
+    int y1 = std::min(y0 + TILE_SIZE, height);
+
+    // Tile-local buffers: view depth of the nearest sphere front so far, and its lit intensity
+    alignas(32) float depth[TILE_SIZE * TILE_SIZE];
+    alignas(32) float shade[TILE_SIZE * TILE_SIZE];
+    std::fill(depth, depth + TILE_SIZE * TILE_SIZE, 1e30f);
+    std::fill(shade, shade + TILE_SIZE * TILE_SIZE, 0.0f);
+
+    alignas(32) static const float laneOffsets[Float8::LANES] = {0.5f, 1.5f, 2.5f, 3.5f, 4.5f, 5.5f, 6.5f, 7.5f}; // pixel centers
+    const Float8 laneCenters = Float8::Load(laneOffsets);
+
+    const std::vector<int>& tileStarts = tileCuller.getTileStarts();
+    const std::vector<int>& tileParticles = tileCuller.getTileParticles();
+    for (int j = tileStarts[tileIndex]; j < tileStarts[tileIndex + 1]; j++) {
+        const Splat& splat = splats[tileParticles[j]];
+        if (splat.radius <= 0.0f) continue;
+
+        // Rows and packets of this tile the disc can touch
+        int rowFirst = std::max(y0, (int)std::floor(splat.center.y - splat.radius));
+        int rowLast = std::min(y1 - 1, (int)std::ceil(splat.center.y + splat.radius));
+        int packetFirst = std::max(0, ((int)std::floor(splat.center.x - splat.radius) - x0) / Float8::LANES);
+        int packetLast = std::min(TILE_ROW_PACKETS - 1, ((int)std::ceil(splat.center.x + splat.radius) - x0) / Float8::LANES);
+        if (rowFirst > rowLast || packetFirst > packetLast) continue;
+
+        float invRadius = 1.0f / splat.radius;
+        const Float8 radiusSquared(splat.radius * splat.radius);
+        const Float8 lightX(splat.lightDir.x), lightY(splat.lightDir.y), lightZ(splat.lightDir.z);
+
+        for (int y = rowFirst; y <= rowLast; y++) {
+            float dy = (y + 0.5f) - splat.center.y;
+            Float8 normalY(dy * invRadius);
+            for (int packet = packetFirst; packet <= packetLast; packet++) {
+                Float8 dx = laneCenters + Float8(x0 + packet * Float8::LANES - splat.center.x);
+                int inside = (dx * dx + Float8(dy * dy)) < radiusSquared;
+                if (inside == 0) continue;
+
+                // Sphere front under the pixel: normal (dx, dy, nz) / radius, nearer than the center by radius * nz
+                Float8 normalX = dx * Float8(invRadius);
+                Float8 normalZ = sqrt(max(Float8(1.0f) - normalX * normalX - normalY * normalY, Float8(0.0f)));
+                Float8 z = Float8(splat.depth) - Float8(splat.worldRadius) * normalZ;
+
+                float* depthRow = &depth[(y - y0) * TILE_SIZE + packet * Float8::LANES];
+                float* shadeRow = &shade[(y - y0) * TILE_SIZE + packet * Float8::LANES];
+                Float8 tileDepth = Float8::Load(depthRow);
+                int closer = inside & (z < tileDepth);
+                if (closer == 0) continue;
+
+                // Phong as in the impostor shader, viewed straight on: reflect(-L, n) . V = 2 (n . L) n.z - L.z
+                Float8 normalDotLight = normalX * lightX + normalY * lightY + normalZ * lightZ;
+                Float8 diffuse = max(normalDotLight, Float8(0.0f));
+                Float8 specular = max(Float8(2.0f) * normalDotLight * normalZ - lightZ, Float8(0.0f));
+                for (int i = 0; i < 5; i++) specular = specular * specular; // shininess 32
+                Float8 intensity = Float8(ambientStrength) + Float8(diffuseStrength) * diffuse + Float8(specularStrength) * specular;
+
+                Float8::Select(closer, z, tileDepth).Store(depthRow);
+                Float8::Select(closer, intensity, Float8::Load(shadeRow)).Store(shadeRow);
+            }
+        }
+    }
+
+    for (int y = y0; y < y1; y++) {
+        for (int x = x0; x < x1; x++) {
+            int local = (y - y0) * TILE_SIZE + (x - x0);
+            unsigned char* pixel = &pixels[((size_t)y * width + x) * 4];
+            bool covered = depth[local] < 1e30f;
+            pixel[0] = 0;
+            pixel[1] = 0;
+            pixel[2] = covered ? (unsigned char)(glm::clamp(shade[local], 0.0f, 1.0f) * 255.0f + 0.5f) : 0;
+            pixel[3] = covered ? 255 : 0;
+        }
+    }
+}
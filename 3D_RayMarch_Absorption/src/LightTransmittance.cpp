@@ -0,0 +1,108 @@
+#include "LightTransmittance.hpp"
+
+LightTransmittance::LightTransmittance(){
+    numThreads = std::max(1u, std::thread::hardware_concurrency());
+    volume = nullptr;
+    lightPosition = glm::vec3(0.0f);
+    dims = glm::ivec3(1);
+    origin = glm::vec3(0.0f);
+    voxelSize = 1.0f;
+    transmittance.assign(1, 1.0f);
+}
+
+void LightTransmittance::Build(ParticleVolume& i_volume, const glm::vec3& i_lightPosition){
+    volume = &i_volume;
+    lightPosition = i_lightPosition;
+
+    // Same box as the density volume, every DOWNSAMPLE-th voxel center
+    voxelSize = volume->getVoxelSize() * DOWNSAMPLE;
+    origin = volume->getOrigin();
+    dims = (volume->getDims() - 1) / DOWNSAMPLE + 1;
+    transmittance.assign((size_t)dims.x * dims.y * dims.z, 1.0f);
+
+    // Each thread owns whole z slabs, so no two threads ever write the same voxel
+    int slicesPerThread = (dims.z + numThreads - 1) / numThreads; // ceiling division
+    std::vector<std::thread> threads;
+    for (int t = 0; t < numThreads; ++t) {
+        int start = t * slicesPerThread;
+        int end = std::min(start + slicesPerThread, dims.z);
+        if (start >= end) break;
+        threads.emplace_back(&LightTransmittance::MarchSlabThread, this, start, end);
+    }
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+
+    volume = nullptr;
+}
+
+float LightTransmittance::SampleDensity(const glm::vec3& pos){
+    glm::ivec3 volumeDims = volume->getDims();
+    const std::vector<glm::vec2>& voxels = volume->getVoxels();
+
+    glm::vec3 coord = glm::clamp((pos - volume->getOrigin()) / volume->getVoxelSize(), glm::vec3(0.0f), glm::vec3(volumeDims - 1));
+    glm::ivec3 lo = glm::min(glm::ivec3(coord), volumeDims - 2);
+    lo = glm::max(lo, glm::ivec3(0));
+    glm::ivec3 hi = glm::min(lo + 1, volumeDims - 1);
+    glm::vec3 f = coord - glm::vec3(lo);
+
+    auto density = [&](int x, int y, int z) {
+        return voxels[((size_t)z * volumeDims.y + y) * volumeDims.x + x].y;
+    };
+    float x00 = glm::mix(density(lo.x, lo.y, lo.z), density(hi.x, lo.y, lo.z), f.x);
+    float x10 = glm::mix(density(lo.x, hi.y, lo.z), density(hi.x, hi.y, lo.z), f.x);
+    float x01 = glm::mix(density(lo.x, lo.y, hi.z), density(hi.x, lo.y, hi.z), f.x);
+    float x11 = glm::mix(density(lo.x, hi.y, hi.z), density(hi.x, hi.y, hi.z), f.x);
+    return glm::mix(glm::mix(x00, x10, f.y), glm::mix(x01, x11, f.y), f.z);
+}
+
+void LightTransmittance::MarchSlabThread(int zStart, int zEnd){
+    glm::vec3 volumeMin = volume->getOrigin();
+    glm::vec3 volumeMax = volumeMin + glm::vec3(volume->getDims() - 1) * volume->getVoxelSize();
+
+    // One sample per transmittance voxel along the ray; the density is smooth at that scale
+    float step = voxelSize;
+    float densityScale = ABSORPTION * step / DENSITY_STEP;
+    const float opaqueDepth = 5.5f; // exp(-5.5) is below one 8-bit step
+
+    for (int z = zStart; z < zEnd; z++) {
+        for (int y = 0; y < dims.y; y++) {
+            for (int x = 0; x < dims.x; x++) {
+                glm::vec3 pos = origin + glm::vec3(x, y, z) * voxelSize;
+                glm::vec3 toLight = lightPosition - pos;
+                float lightDistance = glm::length(toLight);
+                if (lightDistance <= ParticleVolume::DENSITY_BAND) continue;
+                glm::vec3 dir = toLight / lightDistance;
+
+                // Density is zero outside the volume, so the march ends where the ray leaves it (or at the light)
+                glm::vec3 invDir = 1.0f / dir;
+                glm::vec3 t0 = (volumeMin - pos) * invDir;
+                glm::vec3 t1 = (volumeMax - pos) * invDir;
+                glm::vec3 tFar = glm::max(t0, t1);
+                float tEnd = std::min(lightDistance, std::min(tFar.x, std::min(tFar.y, tFar.z)));
+
+                float opticalDepth = 0.0f;
+                for (float t = ParticleVolume::DENSITY_BAND; t < tEnd && opticalDepth < opaqueDepth; t += step) {
+                    opticalDepth += densityScale * SampleDensity(pos + t * dir);
+                }
+                transmittance[((size_t)z * dims.y + y) * dims.x + x] = std::exp(-opticalDepth);
+            }
+        }
+    }
+}
+
+const std::vector<float>& LightTransmittance::getTransmittance(){
+    return transmittance;
+}
+
+glm::ivec3 LightTransmittance::getDims(){
+    return dims;
+}
+
+glm::vec3 LightTransmittance::getOrigin(){
+    return origin;
+}
+
+float LightTransmittance::getVoxelSize(){
+    return voxelSize;
+}
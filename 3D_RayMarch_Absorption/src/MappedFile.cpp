@@ -0,0 +1,106 @@
+#include "MappedFile.hpp"
+
+#if defined(LINUX) || defined(MAC)
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile(){
+    data = "";
+    size = 0;
+    mapped = false;
+}
+
+MappedFile::~MappedFile(){
+    Close();
+}
+
+bool MappedFile::Open(const std::string& path){
+    Close();
+#if defined(LINUX) || defined(MAC)
+    int file = open(path.c_str(), O_RDONLY);
+    if (file < 0) return false;
+    struct stat info;
+    if (fstat(file, &info) != 0) {
+        close(file);
+        return false;
+    }
+    size = info.st_size;
+    if (size > 0) {
+        void* view = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, file, 0);
+        if (view == MAP_FAILED) {
+            close(file);
+            size = 0;
+            return false;
+        }
+        madvise(view, size, MADV_SEQUENTIAL);
+        data = (const char*)view;
+        mapped = true;
+    }
+    close(file); // the mapping keeps its own reference
+    return true;
+#else
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    if (!file) return false;
+    buffer.resize((size_t)file.tellg());
+    file.seekg(0);
+    file.read(buffer.data(), buffer.size());
+    data = buffer.data();
+    size = buffer.size();
+    return true;
+#endif
+}
+
+void MappedFile::Close(){
+#if defined(LINUX) || defined(MAC)
+    if (mapped) munmap((void*)data, size);
+#endif
+    buffer.clear();
+    data = "";
+    size = 0;
+    mapped = false;
+}
+
+const char* MappedFile::getData(){
+    return data;
+}
+
+size_t MappedFile::getSize(){
+    return size;
+}
+
+bool WriteFileAtomic(const std::string& path, std::initializer_list<FileChunk> chunks){
+    std::string tempPath = path + ".tmp";
+    {
+        std::ofstream file(tempPath, std::ios::binary);
+        if (!file) return false;
+        for (const FileChunk& chunk : chunks) {
+            file.write((const char*)chunk.data, chunk.size);
+        }
+        if (!file) {
+            file.close();
+            std::remove(tempPath.c_str());
+            return false;
+        }
+    }
+#ifdef MINGW
+    std::remove(path.c_str()); // rename does not replace an existing file on Windows
+#endif
+    if (std::rename(tempPath.c_str(), path.c_str()) != 0) {
+        std::remove(tempPath.c_str());
+        return false;
+    }
+    return true;
+}
+
+const std::string& BasePath(){
+    static const std::string basePath = []() {
+        char* path = SDL_GetBasePath();
+        std::string directory = path ? path : "./";
+        SDL_free(path);
+        return directory;
+    }();
+    return basePath;
+}
@@ -0,0 +1,367 @@
+#include "MeshLoader.hpp"
+
+// .mesh layout: this header, positions (vec3 each), normals (vec3 each), indices (uint32 each)
+struct MeshCacheHeader{
+    char magic[4];
+    uint32_t version;
+    uint64_t sourceHash; // HashBytes() of the OBJ the cache was built from
+    uint64_t sourceSize;
+    uint32_t vertexCount;
+    uint32_t indexCount;
+};
+static const char MESH_CACHE_MAGIC[4] = {'P', 'M', 'S', 'H'};
+static const uint32_t MESH_CACHE_VERSION = 1; // bump when the layout or the mesh processing changes
+
+static bool ReadMeshCache(const std::string& path, uint64_t sourceHash, uint64_t sourceSize, MeshData& mesh){
+    MappedFile file;
+    if (!file.Open(path) || file.getSize() < sizeof(MeshCacheHeader)) return false;
+
+    MeshCacheHeader header;
+    memcpy(&header, file.getData(), sizeof(header));
+    if (memcmp(header.magic, MESH_CACHE_MAGIC, 4) != 0 || header.version != MESH_CACHE_VERSION ||
+        header.sourceHash != sourceHash || header.sourceSize != sourceSize) return false;
+    size_t vertexBytes = (size_t)header.vertexCount * sizeof(glm::vec3);
+    size_t indexBytes = (size_t)header.indexCount * sizeof(uint32_t);
+    if (file.getSize() != sizeof(header) + 2 * vertexBytes + indexBytes) return false;
+
+    const char* payload = file.getData() + sizeof(header);
+    mesh.positions.resize(header.vertexCount);
+    mesh.normals.resize(header.vertexCount);
+    mesh.indices.resize(header.indexCount);
+    memcpy(mesh.positions.data(), payload, vertexBytes);
+    memcpy(mesh.normals.data(), payload + vertexBytes, vertexBytes);
+    memcpy(mesh.indices.data(), payload + 2 * vertexBytes, indexBytes);
+
+    // A damaged cache must not reach the index buffer
+    for (uint32_t index : mesh.indices) {
+        if (index >= header.vertexCount) return false;
+    }
+    return true;
+}
+
+static void WriteMeshCache(const std::string& path, uint64_t sourceHash, uint64_t sourceSize, const MeshData& mesh){
+    MeshCacheHeader header;
+    memcpy(header.magic, MESH_CACHE_MAGIC, 4);
+    header.version = MESH_CACHE_VERSION;
+    header.sourceHash = sourceHash;
+    header.sourceSize = sourceSize;
+    header.vertexCount = mesh.positions.size();
+    header.indexCount = mesh.indices.size();
+
+    // A failed write (e.g. a read-only models directory) only means the OBJ is parsed again next time
+    WriteFileAtomic(path, {{&header, sizeof(header)},
+                           {mesh.positions.data(), mesh.positions.size() * sizeof(glm::vec3)},
+                           {mesh.normals.data(), mesh.normals.size() * sizeof(glm::vec3)},
+                           {mesh.indices.data(), mesh.indices.size() * sizeof(uint32_t)}});
+}
+
+bool LoadMesh(const std::string& objPath, MeshData& mesh){
+    MappedFile source;
+    if (!source.Open(objPath)) {
+        std::cout << "Could not open model: " << objPath << "\n";
+        return false;
+    }
+    uint64_t sourceHash = HashBytes(source.getData(), source.getSize());
+
+    std::string cachePath = objPath;
+    size_t dot = cachePath.rfind('.');
+    if (dot != std::string::npos && cachePath.find_first_of("/\\", dot) == std::string::npos) {
+        cachePath.resize(dot);
+    }
+    cachePath += ".mesh";
+    if (ReadMeshCache(cachePath, sourceHash, source.getSize(), mesh)) return true;
+
+    if (!ParseOBJ(source.getData(), source.getData() + source.getSize(), mesh)) {
+        std::cout << "Could not parse model: " << objPath << "\n";
+        return false;
+    }
+    OptimizeVertexCache(mesh);
+    WriteMeshCache(cachePath, sourceHash, source.getSize(), mesh);
+    return true;
+}
+
+// Bounded by end on every read - a mapped file has no terminating zero
+static void SkipSpaces(const char*& p, const char* end){
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\r')) p++;
+}
+
+static void SkipLine(const char*& p, const char* end){
+    while (p < end && *p != '\n') p++;
+    if (p < end) p++;
+}
+
+static bool IsDigit(char c){
+    return c >= '0' && c <= '9';
+}
+
+static bool ParseInt(const char*& p, const char* end, long& value){
+    const char* start = p;
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+')) negative = *p++ == '-';
+    if (p >= end || !IsDigit(*p)) {
+        p = start;
+        return false;
+    }
+    value = 0;
+    while (p < end && IsDigit(*p)) value = value * 10 + (*p++ - '0');
+    if (negative) value = -value;
+    return true;
+}
+
+static bool ParseFloat(const char*& p, const char* end, float& value){
+    SkipSpaces(p, end);
+    const char* start = p;
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+')) negative = *p++ == '-';
+
+    double mantissa = 0.0;
+    int exponent = 0;
+    bool digits = false;
+    while (p < end && IsDigit(*p)) {
+        mantissa = mantissa * 10.0 + (*p++ - '0');
+        digits = true;
+    }
+    if (p < end && *p == '.') {
+        p++;
+        while (p < end && IsDigit(*p)) {
+            mantissa = mantissa * 10.0 + (*p++ - '0');
+            exponent--;
+            digits = true;
+        }
+    }
+    if (!digits) {
+        p = start;
+        return false;
+    }
+    if (p < end && (*p == 'e' || *p == 'E')) {
+        const char* e = p++;
+        long exponentValue;
+        if (ParseInt(p, end, exponentValue)) exponent += exponentValue;
+        else p = e;
+    }
+    value = (float)(mantissa * std::pow(10.0, exponent));
+    if (negative) value = -value;
+    return true;
+}
+
+bool ParseOBJ(const char* begin, const char* end, MeshData& mesh){
+    mesh.positions.clear();
+    mesh.normals.clear();
+    mesh.indices.clear();
+
+    std::vector<glm::vec3> filePositions;
+    std::vector<glm::vec3> fileNormals;
+    std::vector<int64_t> vertexPosition; // per output vertex, index into filePositions
+    std::vector<int64_t> vertexNormal; // per output vertex, index into fileNormals, or -1 without one
+    std::unordered_map<uint64_t, uint32_t> vertexOfCorner; // position index << 32 | (normal index + 1) -> output vertex
+    vertexOfCorner.reserve((end - begin) / 64);
+    std::vector<uint32_t> faceCorners; // reused by every face line
+
+    const char* p = begin;
+    while (p < end) {
+        SkipSpaces(p, end);
+        if (p + 1 < end && p[0] == 'v' && (p[1] == ' ' || p[1] == '\t')) {
+            p++;
+            glm::vec3 position;
+            if (!ParseFloat(p, end, position.x) || !ParseFloat(p, end, position.y) || !ParseFloat(p, end, position.z)) return false;
+            filePositions.push_back(position);
+        }
+        else if (p + 2 < end && p[0] == 'v' && p[1] == 'n' && (p[2] == ' ' || p[2] == '\t')) {
+            p += 2;
+            glm::vec3 normal;
+            if (!ParseFloat(p, end, normal.x) || !ParseFloat(p, end, normal.y) || !ParseFloat(p, end, normal.z)) return false;
+            fileNormals.push_back(normal);
+        }
+        else if (p + 1 < end && p[0] == 'f' && (p[1] == ' ' || p[1] == '\t')) {
+            p++;
+            faceCorners.clear();
+            while (true) {
+                SkipSpaces(p, end);
+                if (p >= end || *p == '\n' || *p == '#') break;
+
+                long position, texCoord = 0, normal = 0;
+                if (!ParseInt(p, end, position) || position == 0) return false;
+                if (p < end && *p == '/') {
+                    p++;
+                    if (p < end && *p != '/') ParseInt(p, end, texCoord); // texture coordinates are not used
+                    if (p < end && *p == '/') {
+                        p++;
+                        if (!ParseInt(p, end, normal)) return false;
+                    }
+                }
+
+                // OBJ indices are 1-based, negative ones count back from the last element read so far
+                int64_t positionIndex = position > 0 ? position - 1 : (int64_t)filePositions.size() + position;
+                int64_t normalIndex = normal > 0 ? normal - 1 : (normal < 0 ? (int64_t)fileNormals.size() + normal : -1);
+                if (positionIndex < 0 || normalIndex < -1) return false;
+
+                uint64_t key = (uint64_t)positionIndex << 32 | (uint64_t)(normalIndex + 1);
+                auto inserted = vertexOfCorner.emplace(key, (uint32_t)vertexPosition.size());
+                if (inserted.second) {
+                    vertexPosition.push_back(positionIndex);
+                    vertexNormal.push_back(normalIndex);
+                }
+                faceCorners.push_back(inserted.first->second);
+            }
+            for (size_t i = 1; i + 1 < faceCorners.size(); i++) {
+                mesh.indices.push_back(faceCorners[0]);
+                mesh.indices.push_back(faceCorners[i]);
+                mesh.indices.push_back(faceCorners[i + 1]);
+            }
+        }
+        SkipLine(p, end);
+    }
+
+    // Positive indices may point past what had been read when the face was, so they are checked once everything is
+    size_t numVertices = vertexPosition.size();
+    mesh.positions.resize(numVertices);
+    mesh.normals.resize(numVertices);
+    bool missingNormals = false;
+    for (size_t i = 0; i < numVertices; i++) {
+        if (vertexPosition[i] >= (int64_t)filePositions.size() || vertexNormal[i] >= (int64_t)fileNormals.size()) return false;
+        mesh.positions[i] = filePositions[vertexPosition[i]];
+        if (vertexNormal[i] >= 0) mesh.normals[i] = fileNormals[vertexNormal[i]];
+        else missingNormals = true;
+    }
+
+    if (missingNormals) {
+        // Summed unnormalized face normals weigh each face by its area
+        std::vector<glm::vec3> positionNormals(filePositions.size(), glm::vec3(0.0f));
+        for (size_t i = 0; i + 2 < mesh.indices.size(); i += 3) {
+            const glm::vec3& a = mesh.positions[mesh.indices[i]];
+            const glm::vec3& b = mesh.positions[mesh.indices[i + 1]];
+            const glm::vec3& c = mesh.positions[mesh.indices[i + 2]];
+            glm::vec3 faceNormal = glm::cross(b - a, c - a);
+            for (int k = 0; k < 3; k++) {
+                positionNormals[vertexPosition[mesh.indices[i + k]]] += faceNormal;
+            }
+        }
+        for (size_t i = 0; i < numVertices; i++) {
+            if (vertexNormal[i] >= 0) continue;
+            glm::vec3 normal = positionNormals[vertexPosition[i]];
+            float length = glm::length(normal);
+            mesh.normals[i] = length > 0.0f ? normal / length : glm::vec3(0.0f, 1.0f, 0.0f);
+        }
+    }
+    return true;
+}
+
+// Forsyth, "Linear-Speed Vertex Cache Optimisation": greedily emit the triangle whose vertices score highest, where a
+// vertex scores for sitting near the front of a simulated LRU cache and for having few triangles left to draw
+static const int VERTEX_CACHE_SIZE = 32;
+
+static float VertexCacheScore(int cachePosition, int remainingTriangles){
+    if (remainingTriangles == 0) return -1.0f;
+    float score = 0.0f;
+    if (cachePosition >= 0) {
+        // The last triangle's three vertices get a fixed score, so the next triangle isn't always a neighbour of it
+        if (cachePosition < 3) score = 0.75f;
+        else score = std::pow(1.0f - (cachePosition - 3) / (float)(VERTEX_CACHE_SIZE - 3), 1.5f);
+    }
+    return score + 2.0f / std::sqrt((float)remainingTriangles);
+}
+
+void OptimizeVertexCache(MeshData& mesh){
+    size_t numVertices = mesh.positions.size();
+    size_t numTriangles = mesh.indices.size() / 3;
+    if (numTriangles == 0) return;
+    const std::vector<uint32_t>& indices = mesh.indices;
+
+    // Triangles of each vertex, packed; the first remaining[v] entries of a vertex's range are the ones still to emit
+    std::vector<int> remaining(numVertices, 0);
+    for (uint32_t index : indices) remaining[index]++;
+    std::vector<uint32_t> offsets(numVertices + 1, 0);
+    for (size_t v = 0; v < numVertices; v++) offsets[v + 1] = offsets[v] + remaining[v];
+    std::vector<uint32_t> vertexTriangles(indices.size());
+    std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+    for (size_t i = 0; i < indices.size(); i++) vertexTriangles[fill[indices[i]]++] = i / 3;
+
+    std::vector<int> cachePosition(numVertices, -1);
+    std::vector<float> vertexScore(numVertices);
+    for (size_t v = 0; v < numVertices; v++) vertexScore[v] = VertexCacheScore(-1, remaining[v]);
+    std::vector<uint8_t> emitted(numTriangles, 0);
+
+    std::vector<uint32_t> cache;
+    cache.reserve(VERTEX_CACHE_SIZE + 3);
+    std::vector<uint32_t> ordered;
+    ordered.reserve(indices.size());
+    size_t nextInOrder = 0;
+    int64_t best = -1;
+    while (ordered.size() < indices.size()) {
+        if (best < 0) {
+            // Nothing in the cache has triangles left - carry on from the next triangle in the original order
+            while (emitted[nextInOrder]) nextInOrder++;
+            best = nextInOrder;
+        }
+        emitted[best] = 1;
+        for (int k = 0; k < 3; k++) {
+            uint32_t v = indices[best * 3 + k];
+            ordered.push_back(v);
+
+            uint32_t* triangles = &vertexTriangles[offsets[v]];
+            for (int i = 0; i < remaining[v]; i++) {
+                if (triangles[i] == best) {
+                    triangles[i] = triangles[remaining[v] - 1];
+                    break;
+                }
+            }
+            remaining[v]--;
+
+            auto cached = std::find(cache.begin(), cache.end(), v);
+            if (cached != cache.end()) cache.erase(cached);
+            cache.insert(cache.begin(), v);
+        }
+
+        // Only vertices in (or just pushed out of) the cache change score, and with them only their triangles
+        for (size_t i = 0; i < cache.size(); i++) {
+            uint32_t v = cache[i];
+            cachePosition[v] = i < VERTEX_CACHE_SIZE ? (int)i : -1;
+            vertexScore[v] = VertexCacheScore(cachePosition[v], remaining[v]);
+        }
+        best = -1;
+        float bestScore = -1.0f;
+        for (size_t i = 0; i < std::min(cache.size(), (size_t)VERTEX_CACHE_SIZE); i++) {
+            uint32_t v = cache[i];
+            for (int j = 0; j < remaining[v]; j++) {
+                uint32_t t = vertexTriangles[offsets[v] + j];
+                float score = vertexScore[indices[t * 3]] + vertexScore[indices[t * 3 + 1]] + vertexScore[indices[t * 3 + 2]];
+                if (score > bestScore) {
+                    bestScore = score;
+                    best = t;
+                }
+            }
+        }
+        if (cache.size() > VERTEX_CACHE_SIZE) cache.resize(VERTEX_CACHE_SIZE);
+    }
+
+    // Number vertices by first use; vertices no triangle uses are dropped
+    std::vector<uint32_t> newIndex(numVertices, UINT32_MAX);
+    uint32_t numUsed = 0;
+    for (uint32_t& index : ordered) {
+        if (newIndex[index] == UINT32_MAX) newIndex[index] = numUsed++;
+        index = newIndex[index];
+    }
+    std::vector<glm::vec3> positions(numUsed);
+    std::vector<glm::vec3> normals(numUsed);
+    for (size_t v = 0; v < numVertices; v++) {
+        if (newIndex[v] == UINT32_MAX) continue;
+        positions[newIndex[v]] = mesh.positions[v];
+        normals[newIndex[v]] = mesh.normals[v];
+    }
+    mesh.positions.swap(positions);
+    mesh.normals.swap(normals);
+    mesh.indices.swap(ordered);
+}
+
+float AverageCacheMissRatio(const std::vector<uint32_t>& indices, int cacheSize){
+    if (indices.size() < 3) return 0.0f;
+    uint32_t maxIndex = *std::max_element(indices.begin(), indices.end());
+
+    // A vertex is in a FIFO cache while fewer than cacheSize other vertices have entered it since it did
+    std::vector<int64_t> entered(maxIndex + 1, INT64_MIN / 2);
+    int64_t misses = 0;
+    for (uint32_t index : indices) {
+        if (misses - entered[index] > cacheSize) entered[index] = misses++;
+    }
+    return (float)misses / (indices.size() / 3);
+}
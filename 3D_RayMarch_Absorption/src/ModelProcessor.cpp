@@ -1,6 +1,6 @@
 #include "ModelProcessor.hpp"
 
-ModelProcessor::ModelProcessor() : outFile("output.txt"){
+ModelProcessor::ModelProcessor(){
     gVertexArrayObjects_map["Particle"] = {};
     gVertexBufferObjects_map["Particle"] = {};
     gIndexBufferObjects_map["Particle"] = {};
@@ -10,21 +10,20 @@ ModelProcessor::ModelProcessor() : outFile("output.txt"){
     gVertexArrayObjects_map["Box"] = {};
     gVertexBufferObjects_map["Box"] = {};
     gIndexBufferObjects_map["Box"] = {};
-    srand(static_cast<unsigned>(time(0)));
 }
 
-void ModelProcessor::VertexSpecification(int gSolverGetParticlesSize){
-    GenerateGLuintObjects(gSolverGetParticlesSize, "Particle");
+void ModelProcessor::VertexSpecification(){
+    GenerateGLuintObjects(1, "Particle");
 
-    GenerateModelBufferData(gSolverGetParticlesSize, "/Users/natashadaas/ParticleSimulation/3D/src/models/sphereCorrect.obj", "Particle");
+    GenerateModelBufferData(1, ModelPath("sphereCorrect.obj"), "Particle");
 
     GenerateGLuintObjects(1, "Light");
 
-    GenerateModelBufferData(1, "/Users/natashadaas/ParticleSimulation/3D/src/models/sphereCorrect.obj", "Light");
+    GenerateModelBufferData(1, ModelPath("sphereCorrect.obj"), "Light");
 
     GenerateGLuintObjects(1, "Box");
 
-    GenerateModelBufferData(1, "/Users/natashadaas/ParticleSimulation/3D/src/models/cube.obj", "Box");
+    GenerateModelBufferData(1, ModelPath("cube.obj"), "Box");
 }
 
 // Generate newGVertexArrayObject, newGVertexBufferObject and newGIndexBufferObject for each particle
@@ -58,18 +57,18 @@ void ModelProcessor::GenerateModelBufferData(int numObjects, std::string particl
 }
 
 void ModelProcessor::GenerateModelBlueprint(std::string particleObjFilepath, std::string objName){
-    for (const auto& pair : modelObjFilepath_map) {
-        std::cout << "Key: " << pair.first << ", Value: " << pair.second << std::endl;
-    }
-    if (modelObjFilepath_map.find(objName) == modelObjFilepath_map.end() || modelObjFilepath_map.size() == 0) {
-        GenerateModelData(particleObjFilepath, objName); // This creates a particle "blueprint"
-
-        // Fix indices information from 0 - n to 1 - n
-        offsetGModelIndices(objName);
+    if (modelObjFilepath_map.find(objName) == modelObjFilepath_map.end()) {
+        auto loadStart = std::chrono::high_resolution_clock::now();
+        GenerateModelData(particleObjFilepath); // This creates a particle "blueprint"
+        auto loadEnd = std::chrono::high_resolution_clock::now();
 
         modelObjFilepath_map[objName] = particleObjFilepath;
 
-        std::cout << "Blueprint for " << objName << " created." << std::endl;
+        // Vertex shader runs per triangle with a 16 entry FIFO cache - about 0.7 once OptimizeVertexCache() has run
+        const std::vector<uint32_t>& indices = gModelMeshes_map[particleObjFilepath].indices;
+        std::cout << "Blueprint for " << objName << " created ("
+                  << indices.size() / 3 << " triangles, ACMR " << AverageCacheMissRatio(indices, 16) << ", "
+                  << std::chrono::duration<double, std::milli>(loadEnd - loadStart).count() << " ms)." << std::endl;
     }
     else{
         std::cout << "Blueprint for " << objName << " already created. Skipping." << std::endl;
@@ -78,6 +77,7 @@ void ModelProcessor::GenerateModelBlueprint(std::string particleObjFilepath, std
 }
 
 void ModelProcessor::PrepareAndSendRenderDataToBuffers(int numObjects, std::string objName){
+    const MeshData& mesh = gModelMeshes_map[modelObjFilepath_map[objName]];
     std::vector<std::vector<GLfloat>> gVertexData;
 
     // Hardcoding colors for particles
@@ -105,18 +105,15 @@ void ModelProcessor::PrepareAndSendRenderDataToBuffers(int numObjects, std::stri
         }*/
         glm::vec3 randColor = glm::vec3(0.0f,0.0f,1.0f);
 
-        std::vector<GLfloat> vertexData_i = getVerticesAndAddColorData(objName, randColor);
-        gVertexData.push_back(vertexData_i);
+        gVertexData.push_back(getVerticesAndAddColorData(mesh, randColor));
     }
 
-    std::vector<int> gModelIndices = gModelIndices_map[objName];
-    int gTotalIndices = gModelIndices.size();
-    gTotalIndices_map[objName] = gTotalIndices;
+    const std::vector<uint32_t>& gModelIndices = mesh.indices;
+    gTotalIndices_map[objName] = gModelIndices.size();
 
     // Send rendering data to buffers for each object instance
     for (int i = 0; i < numObjects; i++) {
 
-        glGenVertexArrays(1, &gVertexArrayObjects_map[objName][i]);
         glBindVertexArray(gVertexArrayObjects_map[objName][i]);
 
         glBindBuffer(GL_ARRAY_BUFFER, gVertexBufferObjects_map[objName][i]);
@@ -127,8 +124,7 @@ void ModelProcessor::PrepareAndSendRenderDataToBuffers(int numObjects, std::stri
                     gVertexData[i].data(), 						// Raw array of data
                     GL_STATIC_DRAW);								// How we intend to use the data
 
-        // Generate EBO
-        glGenBuffers(1, &gIndexBufferObjects_map[objName][i]);
+        // EBO (generated with the VAO and VBO in GenerateGLuintObjects)
         glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, gIndexBufferObjects_map[objName][i]);
         glBufferData(GL_ELEMENT_ARRAY_BUFFER, gModelIndices.size() * sizeof(GLuint), gModelIndices.data(), GL_STATIC_DRAW);
 
@@ -136,171 +132,35 @@ void ModelProcessor::PrepareAndSendRenderDataToBuffers(int numObjects, std::stri
     }
 }
 
-void ModelProcessor::GenerateModelData(std::string modelObjFilepath, std::string objName){
-    ParseModelData(modelObjFilepath, objName);
-    getModelMesh(objName);
-}
-
-void ModelProcessor::ParseModelData(std::string filepath, std::string objName){
-    outFile << "--- In parseModelData() ---" << std::endl;
-    std::ifstream inputFile(filepath);
-
-    // Check if the file opened successfully
-    if (!inputFile) {
-        std::cerr << "Error opening file: " << filepath << std::endl;
-    }
-
-    std::vector<Vertex> gModelVertices;
-    std::vector<Vertex> gModelNormals;
-    std::unordered_map<int, int> gModelNormalsMap;
-    std::vector<int> gModelIndices;
-
-    std::string line;
-    // Read each line from the file
-    while (std::getline(inputFile, line)) {
-        std::istringstream stream(line);
-        std::string word;
-        std::vector<std::string> words;
-
-        while (stream >> word) {
-            words.push_back(word); // Add each word to the vector
-        }
-
-        if (words[0] == "v") {
-            Vertex v(glm::vec3(std::stof(words[1]), std::stof(words[2]), std::stof(words[3])));
-            v.printVertex("Vertex");
-            gModelVertices.push_back(v);
-        }
-        if (words[0] == "vn") {
-            Vertex v(glm::vec3(std::stof(words[1]), std::stof(words[2]), std::stof(words[3])));
-            v.printVertex("Normal");
-            gModelNormals.push_back(v);
-        }
-        if (words[0] == "f") {
-            std::string vertexNormalIndex;
-            std::vector<int> indices; // for vertices
-            std::vector<int> normals; // for normals
-
-            for (int i = 1; i <=3; i++) {
-                std::stringstream ss(words[i]);
-                ss >> vertexNormalIndex; // vertexNormalIndex refers to vertexIndex//normalIndex
-                size_t pos = vertexNormalIndex.find("//");
-                std::string vertexIndexPart = vertexNormalIndex.substr(0, pos);
-                std::string normalIndexPart = vertexNormalIndex.substr(pos + 2);
-                indices.push_back(std::stoi(vertexIndexPart));
-                normals.push_back(std::stoi(normalIndexPart));
-            }
-
-            outFile << "Indices: " << indices[0] << "," << indices[1] << "," << indices[2] << std::endl;
-            outFile << "Normals: " << normals[0] << "," << normals[1] << "," << normals[2] << std::endl;
-            outFile << "------" << std::endl;
-            gModelIndices.push_back(indices[0]);
-            gModelIndices.push_back(indices[1]);
-            gModelIndices.push_back(indices[2]);
-            gModelIndices.push_back(normals[0]);
-            gModelIndices.push_back(normals[1]);
-            gModelIndices.push_back(normals[2]);
-            gModelNormalsMap[indices[0] - 1] = normals[0] - 1;
-            gModelNormalsMap[indices[1] - 1] = normals[1] - 1;
-            gModelNormalsMap[indices[2] - 1] = normals[2] - 1;
-        }
-    }
-
-    // Store data in respective maps
-    gModelVertices_map[objName] = gModelVertices;
-    gModelNormals_map[objName] = gModelNormals;
-    gModelIndices_map[objName] = gModelIndices;
-    gModelNormalsMap_map[objName] = gModelNormalsMap;
+void ModelProcessor::GenerateModelData(std::string modelObjFilepath){
+    if (gModelMeshes_map.find(modelObjFilepath) != gModelMeshes_map.end()) return; // another object uses this model
 
-    // Close the file
-    inputFile.close();
-    outFile << "--- Exiting parseModelData() ---" << std::endl;
-}
-
-void ModelProcessor::getModelMesh(std::string objName) {
-    outFile << "--- In getModelMesh() ---" << std::endl;
-
-    outFile << "-------" << std::endl;
-    outFile << "Collecting Indices into Triangles" << std::endl;
-    outFile << "-------" << std::endl;
-
-    std::vector<Vertex> gModelVertices = gModelVertices_map[objName];
-    std::vector<Vertex> gModelNormals = gModelNormals_map[objName];
-    std::unordered_map<int, int> gModelNormalsMap = gModelNormalsMap_map[objName];
-    std::vector<int> gModelIndices = gModelIndices_map[objName];
-
-    std::vector<Triangle> gMesh;
-
-    for (int i = 0; i < gModelIndices.size(); i++) {
-        
-        outFile << "Triangle" << std::endl;
-
-        outFile << "  Index 1: " << gModelIndices[i] << std::endl;
-        outFile << "  Index 2: " << gModelIndices[i+1] << std::endl;
-        outFile << "  Index 3: " << gModelIndices[i+2] << std::endl;
-        outFile << "  Normal 1: " << gModelNormalsMap[gModelIndices[i] - 1] + 1<< std::endl;
-        outFile << "  Normal 2: " << gModelNormalsMap[gModelIndices[i+1] - 1] + 1<< std::endl;
-        outFile << "  Normal 3: " << gModelNormalsMap[gModelIndices[i+2] - 1] + 1<< std::endl;
-
-        // print Vertices of Triangle
-        outFile << "  Vertices: " << std::endl;
-        gModelVertices[gModelIndices[i] - 1].printVertex("Vertex");
-        gModelVertices[gModelIndices[i + 1] - 1].printVertex("Vertex");
-        gModelVertices[gModelIndices[i + 2] - 1].printVertex("Vertex");
-
-        // print Normals of Triangle
-        outFile << "  Normals: " << std::endl;
-        gModelVertices[gModelIndices[i + 3] - 1].printVertex("Normal");
-        gModelVertices[gModelIndices[i + 4] - 1].printVertex("Normal");
-        gModelVertices[gModelIndices[i + 5] - 1].printVertex("Normal");
-
-        Triangle t(gModelVertices[gModelIndices[i] - 1], gModelVertices[gModelIndices[i + 1] - 1], gModelVertices[gModelIndices[i + 2] - 1], gModelVertices[gModelIndices[i + 3] - 1], gModelVertices[gModelIndices[i + 4] - 1], gModelVertices[gModelIndices[i + 5] - 1]);
-        i = i + 5;
-        gMesh.push_back(t);
+    // On failure the mesh stays empty and the object simply draws nothing
+    MeshData& mesh = gModelMeshes_map[modelObjFilepath];
+    if (!LoadMesh(modelObjFilepath, mesh)) {
+        mesh = MeshData();
     }
-
-    gMesh_map[objName] = gMesh;
-
-    outFile << "-------" << std::endl;
-    outFile<< "End Collecting Indices into Triangles" << std::endl;
-    outFile << "-------" << std::endl;
-
-   outFile << "--- Exiting getModelMesh() ---" << std::endl;
 }
 
-std::vector<GLfloat> ModelProcessor::getVerticesAndAddColorData(std::string objName, glm::vec3 color) {
+std::vector<GLfloat> ModelProcessor::getVerticesAndAddColorData(const MeshData& mesh, glm::vec3 color) {
     std::vector<GLfloat> vertexPositionsAndColor;
+    vertexPositionsAndColor.reserve(mesh.positions.size() * 9);
 
-    std::vector<Vertex> gModelVertices = gModelVertices_map[objName];
-    std::vector<Vertex> gModelNormals = gModelNormals_map[objName];
-    std::unordered_map<int, int> gModelNormalsMap = gModelNormalsMap_map[objName];
-
-    for (int i = 0; i < gModelVertices.size(); i++) {
-        vertexPositionsAndColor.push_back(gModelVertices[i].coordinates.x);
-        vertexPositionsAndColor.push_back(gModelVertices[i].coordinates.y);
-        vertexPositionsAndColor.push_back(gModelVertices[i].coordinates.z);
-        outFile << "Index: " << i << std::endl;
-        outFile << "Vertex: (" << gModelVertices[i].coordinates.x << "," << gModelVertices[i].coordinates.y << "," << gModelVertices[i].coordinates.z << ")" << std::endl;
+    for (size_t i = 0; i < mesh.positions.size(); i++) {
+        vertexPositionsAndColor.push_back(mesh.positions[i].x);
+        vertexPositionsAndColor.push_back(mesh.positions[i].y);
+        vertexPositionsAndColor.push_back(mesh.positions[i].z);
         vertexPositionsAndColor.push_back(color.x);
         vertexPositionsAndColor.push_back(color.y);
         vertexPositionsAndColor.push_back(color.z);
-        vertexPositionsAndColor.push_back(gModelNormals[gModelNormalsMap[i]].coordinates.x);
-        vertexPositionsAndColor.push_back(gModelNormals[gModelNormalsMap[i]].coordinates.y);
-        vertexPositionsAndColor.push_back(gModelNormals[gModelNormalsMap[i]].coordinates.z);
-        outFile << "gModelNormalsMap[i]: " << gModelNormalsMap[i] << std::endl;
-        outFile << "Normal: (" << gModelNormals[gModelNormalsMap[i]].coordinates.x << "," << gModelNormals[gModelNormalsMap[i]].coordinates.y << "," << gModelNormals[gModelNormalsMap[i]].coordinates.z << ")" << std::endl;
-        
+        vertexPositionsAndColor.push_back(mesh.normals[i].x);
+        vertexPositionsAndColor.push_back(mesh.normals[i].y);
+        vertexPositionsAndColor.push_back(mesh.normals[i].z);
     }
 
     return vertexPositionsAndColor;
 }
 
-void ModelProcessor::offsetGModelIndices(std::string objName) {
-   for (int i = 0; i < gModelIndices_map[objName].size(); i++) {
-        gModelIndices_map[objName][i] = gModelIndices_map[objName][i] - 1; 
-    } 
-}
-
 void ModelProcessor::ConfigureVertexAttributes(std::string objName) {
    // Enable the vertex attribute for position
     glEnableVertexAttribArray(0);
@@ -325,27 +185,33 @@ void ModelProcessor::ConfigureVertexAttributes(std::string objName) {
     }
 }
 
-void ModelProcessor::CleanUp(int gSolverGetParticlesSize){
-    for (int i = 0; i < gSolverGetParticlesSize; i++){
-        glDeleteBuffers(1, &gVertexBufferObjects_map["Particle"][i]);
-        glDeleteVertexArrays(1, &gVertexArrayObjects_map["Particle"][i]);
+void ModelProcessor::CleanUp(){
+    for (auto& pair : gVertexBufferObjects_map) {
+        if (!pair.second.empty()) {
+            glDeleteBuffers(pair.second.size(), pair.second.data());
+        }
+    }
+    for (auto& pair : gIndexBufferObjects_map) {
+        if (!pair.second.empty()) {
+            glDeleteBuffers(pair.second.size(), pair.second.data());
+        }
+    }
+    for (auto& pair : gVertexArrayObjects_map) {
+        if (!pair.second.empty()) {
+            glDeleteVertexArrays(pair.second.size(), pair.second.data());
+        }
     }
-
-    glDeleteBuffers(1, &gVertexBufferObjects_map["Light"][0]);
-    glDeleteVertexArrays(1, &gVertexArrayObjects_map["Light"][0]);
-
-    glDeleteBuffers(1, &gVertexBufferObjects_map["Box"][0]);
-    glDeleteVertexArrays(1, &gVertexArrayObjects_map["Box"][0]);
 }
 
-int ModelProcessor::getObjTotalIndices(std::string objName){
-    return gTotalIndices_map[objName];
+MeshHandles ModelProcessor::getMesh(const std::string& objName){
+    MeshHandles mesh;
+    mesh.vertexArrayObject = gVertexArrayObjects_map[objName][0];
+    mesh.vertexBufferObject = gVertexBufferObjects_map[objName][0];
+    mesh.indexBufferObject = gIndexBufferObjects_map[objName][0];
+    mesh.totalIndices = gTotalIndices_map[objName];
+    return mesh;
 }
 
-std::unordered_map<std::string, std::vector<GLuint>> ModelProcessor::getGVertexArrayObjects_map(){
-    return gVertexArrayObjects_map;
+std::string ModelProcessor::ModelPath(const std::string& fileName){
+    return BasePath() + "src/models/" + fileName;
 }
-
-std::unordered_map<std::string, std::vector<GLuint>> ModelProcessor::getGVertexBufferObjects_map(){
-    return gVertexBufferObjects_map;
-}
\ No newline at end of file
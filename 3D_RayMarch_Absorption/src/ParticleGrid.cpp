@@ -0,0 +1,143 @@
+#include "ParticleGrid.hpp"
+
+ParticleGrid::ParticleGrid(){
+    numThreads = std::max(1u, std::thread::hardware_concurrency());
+    origin = glm::vec3(0.0f);
+    dims = glm::ivec3(1);
+    cellSize = 1.0f;
+    maxRadius = 0.0f;
+    blendFactor = 0.0f;
+    boundsMin = glm::vec3(0.0f);
+    boundsMax = glm::vec3(0.0f);
+    cellStarts.assign(2, 0);
+}
+
+void ParticleGrid::Build(ParticleSpan<glm::vec3> positions, ParticleSpan<float> radii, ParticleSpan<uint8_t> flags, float i_blendFactor){
+    blendFactor = i_blendFactor;
+
+    // (1) Compact the active particles and find their bounds
+    compacted.clear();
+    compacted.reserve(positions.size());
+    compactedSource.clear();
+    compactedSource.reserve(positions.size());
+    boundsMin = glm::vec3(1e30f);
+    boundsMax = glm::vec3(-1e30f);
+    maxRadius = 0.0f;
+    for (size_t i = 0; i < positions.size(); i++) {
+        if (flags[i] & PARTICLE_FLAG_ACTIVE) {
+            compacted.push_back(glm::vec4(positions[i], radii[i]));
+            compactedSource.push_back(i);
+            boundsMin = glm::min(boundsMin, positions[i]);
+            boundsMax = glm::max(boundsMax, positions[i]);
+            maxRadius = std::max(maxRadius, radii[i]);
+        }
+    }
+
+    int n = compacted.size();
+    if (n == 0) {
+        boundsMin = boundsMax = glm::vec3(0.0f);
+        dims = glm::ivec3(1);
+        sortedParticles.clear();
+        sortedSource.clear();
+        cellStarts.assign(2, 0);
+        return;
+    }
+
+    // (2) Size the grid - one cell of padding on every side so the 3x3x3 search never leaves the grid
+    cellSize = 2.0f * maxRadius + blendFactor;
+    glm::vec3 extent = boundsMax - boundsMin;
+    dims = glm::ivec3(glm::floor(extent / cellSize)) + 3;
+    float numCells = (float)dims.x * (float)dims.y * (float)dims.z;
+    while (numCells > MAX_CELLS) {
+        // Particles are spread out (e.g. a splash) - coarser cells keep memory and upload size bounded
+        // --> Repeated because the padding cells do not shrink: flat or line-shaped bounds need a few rounds
+        cellSize *= std::cbrt(numCells / MAX_CELLS) * 1.01f;
+        dims = glm::ivec3(glm::floor(extent / cellSize)) + 3;
+        numCells = (float)dims.x * (float)dims.y * (float)dims.z;
+    }
+    origin = boundsMin - glm::vec3(cellSize);
+    int totalCells = dims.x * dims.y * dims.z;
+
+    // (3) Cell index of every particle, in parallel
+    cellOfParticle.resize(n);
+    int particlesPerThread = (n + numThreads - 1) / numThreads; // ceiling division
+    std::vector<std::thread> threads;
+    for (int t = 0; t < numThreads; ++t) {
+        int start = t * particlesPerThread;
+        int end = std::min(start + particlesPerThread, n);
+        if (start >= end) break;
+        threads.emplace_back(&ParticleGrid::ComputeCellsThread, this, start, end);
+    }
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+
+    // (4) Counting sort - stable, so particles keep solver order within a cell and the image does not flicker
+    cellStarts.assign(totalCells + 1, 0);
+    for (int i = 0; i < n; i++) {
+        cellStarts[cellOfParticle[i] + 1]++;
+    }
+    for (int c = 0; c < totalCells; c++) {
+        cellStarts[c + 1] += cellStarts[c];
+    }
+    cellCursor.assign(cellStarts.begin(), cellStarts.end() - 1);
+    sortedParticles.resize(n);
+    sortedSource.resize(n);
+    for (int i = 0; i < n; i++) {
+        int slot = cellCursor[cellOfParticle[i]]++;
+        sortedParticles[slot] = compacted[i];
+        sortedSource[slot] = compactedSource[i];
+    }
+}
+
+void ParticleGrid::ComputeCellsThread(int startIdx, int endIdx){
+    for (int i = startIdx; i < endIdx; i++) {
+        glm::ivec3 cell = glm::ivec3(glm::floor((glm::vec3(compacted[i]) - origin) / cellSize));
+        cell = glm::clamp(cell, glm::ivec3(0), dims - 1);
+        cellOfParticle[i] = (cell.z * dims.y + cell.y) * dims.x + cell.x;
+    }
+}
+
+const std::vector<glm::vec4>& ParticleGrid::getSortedParticles(){
+    return sortedParticles;
+}
+
+const std::vector<int>& ParticleGrid::getSortedSource(){
+    return sortedSource;
+}
+
+const std::vector<int>& ParticleGrid::getCellStarts(){
+    return cellStarts;
+}
+
+int ParticleGrid::getParticleCount(){
+    return sortedParticles.size();
+}
+
+glm::vec3 ParticleGrid::getOrigin(){
+    return origin;
+}
+
+glm::ivec3 ParticleGrid::getDims(){
+    return dims;
+}
+
+float ParticleGrid::getCellSize(){
+    return cellSize;
+}
+
+float ParticleGrid::getMaxRadius(){
+    return maxRadius;
+}
+
+float ParticleGrid::getBlendFactor(){
+    return blendFactor;
+}
+
+glm::vec3 ParticleGrid::getBoundsMin(){
+    return boundsMin;
+}
+
+glm::vec3 ParticleGrid::getBoundsMax(){
+    return boundsMax;
+}
@@ -0,0 +1,26 @@
+#include "ParticleSnapshot.hpp"
+
+SnapshotBuffer::SnapshotBuffer(){
+    writeIndex = 0;
+    sharedIndex.store(1);
+    readIndex = 2;
+}
+
+ParticleSnapshot& SnapshotBuffer::beginWrite(){
+    return slots[writeIndex];
+}
+
+void SnapshotBuffer::publish(){
+    // Swap our finished slot into the hand-off position and take whatever was there (read or not) as the next write slot
+    int previous = sharedIndex.exchange(writeIndex | FRESH_BIT, std::memory_order_acq_rel);
+    writeIndex = previous & ~FRESH_BIT;
+}
+
+const ParticleSnapshot& SnapshotBuffer::acquireLatest(){
+    // Only swap if something new was published, otherwise keep reading the snapshot we already hold
+    if (sharedIndex.load(std::memory_order_acquire) & FRESH_BIT) {
+        int previous = sharedIndex.exchange(readIndex, std::memory_order_acq_rel);
+        readIndex = previous & ~FRESH_BIT;
+    }
+    return slots[readIndex];
+}
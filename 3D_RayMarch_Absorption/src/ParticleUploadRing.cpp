@@ -0,0 +1,154 @@
+#include "ParticleUploadRing.hpp"
+
+#include <cstring>
+
+ParticleUploadRing::ParticleUploadRing(){
+    for (int i = 0; i < RING_SIZE; i++) {
+        buffers[i] = 0;
+        textures[i] = 0;
+        fences[i] = nullptr;
+        capacities[i] = 0;
+    }
+    internalFormat = GL_RGBA32F;
+    texelSize = sizeof(glm::vec4);
+    currentSlot = 0;
+    maxTexels = 0;
+}
+
+void ParticleUploadRing::Create(GLenum i_internalFormat, size_t i_texelSize){
+    internalFormat = i_internalFormat;
+    texelSize = i_texelSize;
+
+    glGenBuffers(RING_SIZE, buffers);
+    glGenTextures(RING_SIZE, textures);
+    glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &maxTexels);
+
+    for (int i = 0; i < RING_SIZE; i++) {
+        EnsureCapacity(i, 1024);
+
+        // The texture views the buffer object, not its current storage, so later reallocations need no re-attach
+        glBindTexture(GL_TEXTURE_BUFFER, textures[i]);
+        glTexBuffer(GL_TEXTURE_BUFFER, internalFormat, buffers[i]);
+    }
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
+}
+
+void ParticleUploadRing::CleanUp(){
+    for (int i = 0; i < RING_SIZE; i++) {
+        if (fences[i] != nullptr) {
+            glDeleteSync(fences[i]);
+            fences[i] = nullptr;
+        }
+    }
+    glDeleteTextures(RING_SIZE, textures);
+    glDeleteBuffers(RING_SIZE, buffers);
+}
+
+GLuint ParticleUploadRing::getCurrentBuffer(){
+    return buffers[currentSlot];
+}
+
+int ParticleUploadRing::getMaxParticles(){
+    return maxTexels;
+}
+
+void ParticleUploadRing::WaitForSlot(int slot){
+    if (fences[slot] == nullptr) return;
+
+    // With three slots in flight this almost never blocks - it only does if the GPU is a full two frames behind
+    GLenum result = glClientWaitSync(fences[slot], GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+    while (result == GL_TIMEOUT_EXPIRED) {
+        result = glClientWaitSync(fences[slot], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000); // 1 ms
+    }
+    glDeleteSync(fences[slot]);
+    fences[slot] = nullptr;
+}
+
+void ParticleUploadRing::EnsureCapacity(int slot, size_t numTexels){
+    if (numTexels <= capacities[slot]) return;
+
+    // Grow geometrically so a steadily growing particle count does not reallocate every frame
+    size_t newCapacity = capacities[slot] == 0 ? numTexels : capacities[slot];
+    while (newCapacity < numTexels) {
+        newCapacity *= 2;
+    }
+
+    // Only the buffer binding is touched here - rebinding textures would clobber whatever unit is active
+    glBindBuffer(GL_TEXTURE_BUFFER, buffers[slot]);
+    glBufferData(GL_TEXTURE_BUFFER, newCapacity * texelSize, nullptr, GL_STREAM_DRAW);
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+    capacities[slot] = newCapacity;
+}
+
+size_t ParticleUploadRing::BeginSlot(size_t numTexels){
+    currentSlot = (currentSlot + 1) % RING_SIZE;
+    WaitForSlot(currentSlot);
+
+    if (maxTexels > 0 && numTexels > (size_t)maxTexels) {
+        std::cout << "ParticleUploadRing: " << numTexels << " texels exceeds GL_MAX_TEXTURE_BUFFER_SIZE ("
+                  << maxTexels << "), the rest is dropped\n";
+        numTexels = maxTexels;
+    }
+    EnsureCapacity(currentSlot, numTexels);
+    return numTexels;
+}
+
+int ParticleUploadRing::Upload(ParticleSpan<glm::vec3> positions, ParticleSpan<float> radii, ParticleSpan<uint8_t> flags){
+    size_t numParticles = BeginSlot(positions.size());
+    if (numParticles == 0) return 0;
+
+    // Unsynchronized is safe here: the fence wait in BeginSlot() already guarantees the GPU is done with this slot
+    glBindBuffer(GL_TEXTURE_BUFFER, buffers[currentSlot]);
+    glm::vec4* mapped = (glm::vec4*)glMapBufferRange(GL_TEXTURE_BUFFER, 0, numParticles * sizeof(glm::vec4),
+                                                     GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+    if (mapped == nullptr) {
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+        std::cout << "ParticleUploadRing: glMapBufferRange failed\n";
+        return 0;
+    }
+
+    // Compact: inactive particles are skipped so the shader never sees them
+    int count = 0;
+    for (size_t i = 0; i < numParticles; i++) {
+        if (flags[i] & PARTICLE_FLAG_ACTIVE) {
+            mapped[count++] = glm::vec4(positions[i], radii[i]);
+        }
+    }
+
+    glUnmapBuffer(GL_TEXTURE_BUFFER);
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+    return count;
+}
+
+int ParticleUploadRing::UploadTexels(const void* data, size_t count){
+    count = BeginSlot(count);
+    if (count == 0) return 0;
+
+    glBindBuffer(GL_TEXTURE_BUFFER, buffers[currentSlot]);
+    void* mapped = glMapBufferRange(GL_TEXTURE_BUFFER, 0, count * texelSize,
+                                    GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+    if (mapped == nullptr) {
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+        std::cout << "ParticleUploadRing: glMapBufferRange failed\n";
+        return 0;
+    }
+    memcpy(mapped, data, count * texelSize);
+
+    glUnmapBuffer(GL_TEXTURE_BUFFER);
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+    return count;
+}
+
+void ParticleUploadRing::Bind(GLuint textureUnit){
+    glActiveTexture(GL_TEXTURE0 + textureUnit);
+    glBindTexture(GL_TEXTURE_BUFFER, textures[currentSlot]);
+    glActiveTexture(GL_TEXTURE0);
+}
+
+void ParticleUploadRing::FenceCurrentSlot(){
+    if (fences[currentSlot] != nullptr) {
+        glDeleteSync(fences[currentSlot]);
+    }
+    fences[currentSlot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
@@ -0,0 +1,128 @@
+#include "ParticleVolume.hpp"
+
+// Same blend as smoothMinimum() in fragRayMarch.glsl
+static float smoothMinimum(float a, float b, float blendFactor){
+    float weight = glm::clamp(0.5f + 0.5f * (b - a) / blendFactor, 0.0f, 1.0f);
+    return glm::mix(b, a, weight) - blendFactor * weight * (1.0f - weight);
+}
+
+ParticleVolume::ParticleVolume(){
+    numThreads = std::max(1u, std::thread::hardware_concurrency());
+    resolution = 64;
+    grid = nullptr;
+    dims = glm::ivec3(1);
+    origin = glm::vec3(0.0f);
+    voxelSize = 1.0f;
+    bandWidth = 1.0f;
+    voxels.assign(1, glm::vec2(bandWidth, 0.0f));
+}
+
+void ParticleVolume::setResolution(int i_resolution){
+    resolution = std::max(2, i_resolution);
+}
+
+int ParticleVolume::getResolution(){
+    return resolution;
+}
+
+void ParticleVolume::Build(ParticleGrid& i_grid){
+    grid = &i_grid;
+
+    float blendFactor = grid->getBlendFactor();
+    float maxRadius = grid->getMaxRadius();
+
+    if (grid->getParticleCount() == 0) {
+        dims = glm::ivec3(1);
+        origin = glm::vec3(0.0f);
+        voxels.assign(1, glm::vec2(bandWidth, 0.0f));
+        grid = nullptr;
+        return;
+    }
+
+    // Cover every particle plus the blend and density falloff around it, with one voxel to spare
+    glm::vec3 extent = grid->getBoundsMax() - grid->getBoundsMin();
+    float longestAxis = std::max(extent.x, std::max(extent.y, extent.z));
+    float padding = maxRadius + std::max(blendFactor, DENSITY_BAND);
+    voxelSize = (longestAxis + 2.0f * padding) / (resolution - 1);
+    padding += voxelSize;
+    origin = grid->getBoundsMin() - glm::vec3(padding);
+    dims = glm::ivec3(glm::ceil((extent + 2.0f * padding) / voxelSize)) + 1;
+
+    // Distances are only exact near the surface - the band just has to cover the density falloff
+    // and give the trilinear filter a couple of voxels on each side
+    bandWidth = std::max(DENSITY_BAND, 2.0f * voxelSize);
+
+    voxels.assign((size_t)dims.x * dims.y * dims.z, glm::vec2(UNSET_DISTANCE, 0.0f));
+
+    // Each thread owns whole z slabs, so no two threads ever write the same voxel
+    int slicesPerThread = (dims.z + numThreads - 1) / numThreads; // ceiling division
+    std::vector<std::thread> threads;
+    for (int t = 0; t < numThreads; ++t) {
+        int start = t * slicesPerThread;
+        int end = std::min(start + slicesPerThread, dims.z);
+        if (start >= end) break;
+        threads.emplace_back(&ParticleVolume::SplatSlabThread, this, start, end);
+    }
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+
+    grid = nullptr;
+}
+
+void ParticleVolume::SplatSlabThread(int zStart, int zEnd){
+    const std::vector<glm::vec4>& particles = grid->getSortedParticles();
+    float blendFactor = grid->getBlendFactor();
+
+    // Particles are splatted in grid order, so every voxel sees the same smooth-min chain order as map()
+    for (const glm::vec4& particle : particles) {
+        glm::vec3 center = glm::vec3(particle);
+        float radius = particle.w;
+
+        // A particle further than band + blend from a voxel cannot pull the blended surface into the band
+        float support = radius + bandWidth + blendFactor;
+        glm::ivec3 lo = glm::max(glm::ivec3(glm::ceil((center - support - origin) / voxelSize)), glm::ivec3(0, 0, zStart));
+        glm::ivec3 hi = glm::min(glm::ivec3(glm::floor((center + support - origin) / voxelSize)), glm::ivec3(dims.x - 1, dims.y - 1, zEnd - 1));
+
+        for (int z = lo.z; z <= hi.z; z++) {
+            for (int y = lo.y; y <= hi.y; y++) {
+                glm::vec2* row = &voxels[((size_t)z * dims.y + y) * dims.x];
+                for (int x = lo.x; x <= hi.x; x++) {
+                    glm::vec3 pos = origin + glm::vec3(x, y, z) * voxelSize;
+                    float d = glm::length(pos - center) - radius;
+                    if (d >= bandWidth + blendFactor) continue;
+
+                    // smoothMinimum(UNSET_DISTANCE, d) == d, so the first particle simply sets the voxel
+                    row[x].x = smoothMinimum(row[x].x, d, blendFactor);
+                }
+            }
+        }
+    }
+
+    // Density comes from the finished blended distance, exactly like mapDensity() - summing it per particle would
+    // count every overlap twice. Then clamp to the narrow band, which also turns untouched voxels into empty space
+    for (size_t i = (size_t)zStart * dims.y * dims.x; i < (size_t)zEnd * dims.y * dims.x; i++) {
+        voxels[i].y = std::max(DENSITY_BAND - voxels[i].x, 0.0f);
+        voxels[i].x = std::min(voxels[i].x, bandWidth);
+    }
+}
+
+const std::vector<glm::vec2>& ParticleVolume::getVoxels(){
+    return voxels;
+}
+
+glm::ivec3 ParticleVolume::getDims(){
+    return dims;
+}
+
+glm::vec3 ParticleVolume::getOrigin(){
+    return origin;
+}
+
+float ParticleVolume::getVoxelSize(){
+    return voxelSize;
+}
+
+float ParticleVolume::getBandWidth(){
+    return bandWidth;
+}
@@ -1,20 +1,125 @@
 #include "Renderer.hpp"
 
+// Cost knobs of each ray-march quality level, compiled into its permutation of fragRayMarch.glsl
+// --> Absorption is summed per DENSITY_STEP and rescaled to LightTransmittance::DENSITY_STEP, and every level gets
+//     enough density steps to reach MAX_DENSITY_DISTANCE into the fluid, so the levels only differ in how finely the
+//     fluid is sampled, not in how dark it looks
+struct RayMarchQualitySettings{
+    int maxMarchSteps; // sphere-tracing steps to find the surface
+    float densityStep; // world units between absorption samples
+};
+static const RayMarchQualitySettings RAY_MARCH_QUALITY_SETTINGS[RAY_MARCH_QUALITY_COUNT] = {
+    {48, 0.2f}, // low
+    {72, 0.15f}, // medium
+    {100, 0.1f}, // high
+};
+static const float MAX_DENSITY_DISTANCE = 10.0f; // how far behind the surface absorption is summed at most
+
 Renderer::Renderer(){}
 
 Renderer::Renderer(int i_screenWidth, int i_screenHeight, Scene* scene){
     screenWidth = i_screenWidth;
     screenHeight = i_screenHeight;
     mainScene = scene;
+    snapshot = nullptr;
 
     rotZ = 0.0f;
+    blendFactor = 0.5f;
+    useVolume = false;
+    volumeThisFrame = false;
+    particleListsOverflowed = false;
+    volumeTextureDims = glm::ivec3(0);
+    lightShadows = false;
+    transmittanceTextureDims = glm::ivec3(0);
+    rayMarchScale = 1.0f;
+    rayMarchWidth = screenWidth;
+    rayMarchHeight = screenHeight;
+    rayMarchTargetSize = glm::ivec2(0);
+    currentRayMarchTarget = 0;
+    temporalMode = false;
+    impostorMode = false;
+    surfaceMeshMode = false;
+    historyValid = false;
+    temporalPhase = 0;
+    previousViewProjection = glm::mat4(1.0f);
+    previousCameraPosition = glm::vec3(0.0f);
+    fluidSmoothingRadius = 0.2f;
+    fluidSmoothingIterations = 2;
+    rayMarchQuality = RAY_MARCH_QUALITY_HIGH;
+
+    projection = glm::perspective(glm::radians(45.0f),
+                                  (float)screenWidth/(float)screenHeight,
+                                  0.1f,
+                                  10000.0f);
 }
 
 void Renderer::updateZ(float val){
     rotZ = rotZ + val;
 }
 
+void Renderer::setSnapshot(const ParticleSnapshot* i_snapshot, float alpha){
+    snapshot = i_snapshot;
+
+    // Render between the last two solver frames so motion stays smooth when render and sim rates differ
+    ParticleSpan<glm::vec3> current = snapshot->getPositions();
+    ParticleSpan<glm::vec3> previous = snapshot->getPreviousPositions();
+    if (alpha >= 1.0f || previous.size() != current.size()) {
+        renderPositions = current; // read straight from the snapshot, no copy
+    }
+    else {
+        interpolatedPositions.resize(current.size());
+        for (size_t i = 0; i < current.size(); i++) {
+            interpolatedPositions[i] = glm::mix(previous[i], current[i], alpha);
+        }
+        renderPositions = ParticleSpan<glm::vec3>(interpolatedPositions);
+    }
+}
+
+void Renderer::setVolumeResolution(int resolution){
+    useVolume = resolution > 0;
+    if (useVolume) {
+        particleVolume.setResolution(resolution);
+        surfaceExtractor.setResolution(resolution);
+    }
+}
+
+void Renderer::setSurfaceMeshMode(bool enabled){
+    surfaceMeshMode = enabled;
+}
+
+void Renderer::setLightShadows(bool enabled){
+    lightShadows = enabled;
+}
+
+void Renderer::setRayMarchScale(float scale){
+    rayMarchScale = glm::clamp(scale, 0.25f, 1.0f);
+}
+
+void Renderer::setTemporalMode(bool enabled){
+    if (enabled && !temporalMode) {
+        historyValid = false; // whatever is in the history target is not last frame
+    }
+    temporalMode = enabled;
+}
+
+void Renderer::setImpostorMode(bool enabled){
+    impostorMode = enabled;
+}
+
+void Renderer::setRayMarchQuality(RayMarchQuality quality){
+    if (quality != rayMarchQuality) {
+        historyValid = false; // last frame was marched at another level
+    }
+    rayMarchQuality = quality;
+    if (gGraphicsRayMarchingPermutationPrograms[quality] != 0) {
+        gGraphicsRayMarchingPipelineShaderProgram = gGraphicsRayMarchingPermutationPrograms[quality];
+        rayMarchUniforms = rayMarchPermutationUniforms[quality];
+    }
+}
+
 void Renderer::CreateGraphicsPipelines(){
+    auto pipelinesStart = std::chrono::high_resolution_clock::now();
+    shaderCache.Initialize();
 
     std::string vertexShaderSource      = LoadShaderAsString("./shaders/vertPhong.glsl");
     std::string fragmentShaderSource    = LoadShaderAsString("./shaders/fragPhong.glsl");
@@ -30,7 +135,148 @@ void Renderer::CreateGraphicsPipelines(){
     std::string vertexShaderSource_rayMarch      = LoadShaderAsString("./shaders/vertRayMarch.glsl");
     std::string fragmentShaderSource_rayMarch     = LoadShaderAsString("./shaders/fragRayMarch.glsl");
 
-    gGraphicsRayMarchingPipelineShaderProgram = CreateShaderProgram(vertexShaderSource_rayMarch,fragmentShaderSource_rayMarch);
+    for (int quality = 0; quality < RAY_MARCH_QUALITY_COUNT; quality++) {
+        std::string fragmentShaderSource_permutation = AddShaderDefines(fragmentShaderSource_rayMarch, RayMarchDefines((RayMarchQuality)quality));
+        gGraphicsRayMarchingPermutationPrograms[quality] = CreateShaderProgram(vertexShaderSource_rayMarch,fragmentShaderSource_permutation);
+    }
+
+    std::string fragmentShaderSource_upsample     = LoadShaderAsString("./shaders/fragUpsample.glsl");
+
+    gGraphicsUpsamplePipelineShaderProgram = CreateShaderProgram(vertexShaderSource_rayMarch,fragmentShaderSource_upsample);
+
+    std::string vertexShaderSource_impostor      = LoadShaderAsString("./shaders/vertImpostor.glsl");
+    std::string fragmentShaderSource_impostor     = LoadShaderAsString("./shaders/fragImpostor.glsl");
+
+    gGraphicsImpostorPipelineShaderProgram = CreateShaderProgram(vertexShaderSource_impostor,fragmentShaderSource_impostor);
+
+    // Screen-space fluid: the splats reuse the impostor quads, the full-screen passes the ray marcher's triangle
+    std::string fragmentShaderSource_fluidDepth      = LoadShaderAsString("./shaders/fragFluidDepth.glsl");
+    std::string fragmentShaderSource_fluidThickness  = LoadShaderAsString("./shaders/fragFluidThickness.glsl");
+    std::string fragmentShaderSource_fluidSmooth     = LoadShaderAsString("./shaders/fragFluidSmooth.glsl");
+    std::string fragmentShaderSource_fluidComposite  = LoadShaderAsString("./shaders/fragFluidComposite.glsl");
+
+    gGraphicsFluidDepthPipelineShaderProgram = CreateShaderProgram(vertexShaderSource_impostor,fragmentShaderSource_fluidDepth);
+    gGraphicsFluidThicknessPipelineShaderProgram = CreateShaderProgram(vertexShaderSource_impostor,fragmentShaderSource_fluidThickness);
+    gGraphicsFluidSmoothPipelineShaderProgram = CreateShaderProgram(vertexShaderSource_rayMarch,fragmentShaderSource_fluidSmooth);
+    gGraphicsFluidCompositePipelineShaderProgram = CreateShaderProgram(vertexShaderSource_rayMarch,fragmentShaderSource_fluidComposite);
+
+    ResolveUniformLocations();
+    setRayMarchQuality(rayMarchQuality);
+
+    auto pipelinesEnd = std::chrono::high_resolution_clock::now();
+    std::cout << "Shader programs: " << shaderCache.getHitCount() << " from cache, " << shaderCache.getMissCount() << " built ("
+              << std::chrono::duration<double, std::milli>(pipelinesEnd - pipelinesStart).count() << " ms)\n";
+}
+
+std::string Renderer::AddShaderDefines(const std::string& source, const std::string& defines){
+    // #version has to stay first; #line keeps compiler messages on the file's own line numbers
+    size_t versionEnd = source.find('\n') + 1;
+    return source.substr(0, versionEnd) + defines + "#line 2\n" + source.substr(versionEnd);
+}
+
+std::string Renderer::RayMarchDefines(RayMarchQuality quality){
+    const RayMarchQualitySettings& settings = RAY_MARCH_QUALITY_SETTINGS[quality];
+    int maxDensitySteps = (int)std::ceil(MAX_DENSITY_DISTANCE / settings.densityStep - 0.001f); // 50, 67, 100
+    char defines[512];
+    snprintf(defines, sizeof(defines),
+             "#define MAX_MARCH_STEPS %d\n"
+             "#define MAX_DENSITY_STEPS %d\n"
+             "#define DENSITY_STEP %.6f\n"
+             "#define DENSITY_SAMPLE_WEIGHT %.6f\n"
+             "#define ABSORPTION %.6f\n"
+             "#define BLEND_FACTOR %.6f\n",
+             settings.maxMarchSteps, maxDensitySteps, settings.densityStep,
+             settings.densityStep / LightTransmittance::DENSITY_STEP, LightTransmittance::ABSORPTION, blendFactor);
+    return defines;
+}
+
+void Renderer::ResolveUniformLocations(){
+    BindFrameState(gGraphicsPipelineShaderProgram);
+    BindFrameState(gGraphicsLighterPipelineShaderProgram);
+    BindFrameState(gGraphicsImpostorPipelineShaderProgram);
+    BindFrameState(gGraphicsFluidDepthPipelineShaderProgram);
+    BindFrameState(gGraphicsFluidThicknessPipelineShaderProgram);
+    BindFrameState(gGraphicsFluidCompositePipelineShaderProgram);
+
+	// Note: the error keeps showing up until you actually USE u_ModelMatrix in vert.glsl
+    lighterUniforms.modelMatrix = glGetUniformLocation(gGraphicsLighterPipelineShaderProgram, "u_ModelMatrix");
+    if (lighterUniforms.modelMatrix < 0) {
+        std::cout << "Could not find u_ModelMatrix, maybe a mispelling?\n";
+        exit(EXIT_FAILURE);
+    }
+
+    GLuint program = 0;
+    for (int quality = 0; quality < RAY_MARCH_QUALITY_COUNT; quality++) {
+        program = gGraphicsRayMarchingPermutationPrograms[quality];
+        RayMarchUniforms& uniforms = rayMarchPermutationUniforms[quality];
+        BindFrameState(program);
+        uniforms.iResolution = glGetUniformLocation(program, "iResolution");
+        uniforms.iTime = glGetUniformLocation(program, "iTime");
+        uniforms.particleCount = glGetUniformLocation(program, "particleCount");
+        uniforms.useVolume = glGetUniformLocation(program, "useVolume");
+        uniforms.fluidBoundsMin = glGetUniformLocation(program, "fluidBoundsMin");
+        uniforms.fluidBoundsMax = glGetUniformLocation(program, "fluidBoundsMax");
+        uniforms.gridOrigin = glGetUniformLocation(program, "gridOrigin");
+        uniforms.gridDims = glGetUniformLocation(program, "gridDims");
+        uniforms.cellSize = glGetUniformLocation(program, "cellSize");
+        uniforms.maxRadius = glGetUniformLocation(program, "maxRadius");
+        uniforms.tileCounts = glGetUniformLocation(program, "tileCounts");
+        uniforms.volumeOrigin = glGetUniformLocation(program, "volumeOrigin");
+        uniforms.voxelSize = glGetUniformLocation(program, "voxelSize");
+        uniforms.useLightShadows = glGetUniformLocation(program, "useLightShadows");
+        uniforms.transmittanceOrigin = glGetUniformLocation(program, "transmittanceOrigin");
+        uniforms.transmittanceVoxelSize = glGetUniformLocation(program, "transmittanceVoxelSize");
+        uniforms.temporalMode = glGetUniformLocation(program, "temporalMode");
+        uniforms.temporalPhase = glGetUniformLocation(program, "temporalPhase");
+        uniforms.previousViewProjection = glGetUniformLocation(program, "previousViewProjection");
+        uniforms.previousCameraPosition = glGetUniformLocation(program, "previousCameraPosition");
+
+        // Every sampler keeps its own unit even when unused - samplers of different types may not share one
+        glUseProgram(program);
+        glUniform1i(glGetUniformLocation(program, "particleData"), 0);
+        glUniform1i(glGetUniformLocation(program, "cellStarts"), 1);
+        glUniform1i(glGetUniformLocation(program, "volumeTexture"), 2);
+        glUniform1i(glGetUniformLocation(program, "tileParticles"), 3);
+        glUniform1i(glGetUniformLocation(program, "tileStarts"), 4);
+        glUniform1i(glGetUniformLocation(program, "historyColor"), 5);
+        glUniform1i(glGetUniformLocation(program, "historyGeometry"), 6);
+        glUniform1i(glGetUniformLocation(program, "historyMotion"), 7);
+        glUniform1i(glGetUniformLocation(program, "particleMotion"), 8);
+        glUniform1i(glGetUniformLocation(program, "lightTransmittance"), 9);
+    }
+
+    glUseProgram(gGraphicsImpostorPipelineShaderProgram);
+    glUniform1f(glGetUniformLocation(gGraphicsImpostorPipelineShaderProgram, "radiusPadding"), 0.0f);
+    glUseProgram(gGraphicsFluidDepthPipelineShaderProgram);
+    glUniform1f(glGetUniformLocation(gGraphicsFluidDepthPipelineShaderProgram, "radiusPadding"), 0.0f);
+    glUseProgram(gGraphicsFluidThicknessPipelineShaderProgram);
+    glUniform1f(glGetUniformLocation(gGraphicsFluidThicknessPipelineShaderProgram, "radiusPadding"), ParticleVolume::DENSITY_BAND);
+
+    glUseProgram(gGraphicsUpsamplePipelineShaderProgram);
+    glUniform1i(glGetUniformLocation(gGraphicsUpsamplePipelineShaderProgram, "rayMarchColor"), 0);
+    glUniform1i(glGetUniformLocation(gGraphicsUpsamplePipelineShaderProgram, "rayMarchGeometry"), 1);
+
+    program = gGraphicsFluidSmoothPipelineShaderProgram;
+    fluidSmoothUniforms.direction = glGetUniformLocation(program, "direction");
+    fluidSmoothUniforms.smoothingRadius = glGetUniformLocation(program, "smoothingRadius");
+    fluidSmoothUniforms.projectionScale = glGetUniformLocation(program, "projectionScale");
+    glUseProgram(program);
+    glUniform1i(glGetUniformLocation(program, "fluidDepth"), 0);
+
+    glUseProgram(gGraphicsFluidCompositePipelineShaderProgram);
+    glUniform1i(glGetUniformLocation(gGraphicsFluidCompositePipelineShaderProgram, "fluidDepth"), 0);
+    glUniform1i(glGetUniformLocation(gGraphicsFluidCompositePipelineShaderProgram, "fluidThickness"), 1);
+    glUniform1f(glGetUniformLocation(gGraphicsFluidCompositePipelineShaderProgram, "absorptionPerUnit"),
+                LightTransmittance::ABSORPTION / LightTransmittance::DENSITY_STEP);
+    glUniform1f(glGetUniformLocation(gGraphicsFluidCompositePipelineShaderProgram, "thicknessScale"), FLUID_DENSITY_OVERLAP);
+    glUseProgram(0);
+}
+
+void Renderer::BindFrameState(GLuint shaderProgram){
+    GLuint blockIndex = glGetUniformBlockIndex(shaderProgram, "FrameState");
+    if (blockIndex != GL_INVALID_INDEX) {
+        glUniformBlockBinding(shaderProgram, blockIndex, FRAME_STATE_BINDING);
+    }
 }
 
 std::string Renderer::LoadShaderAsString(const std::string& filename){
@@ -51,8 +297,18 @@ std::string Renderer::LoadShaderAsString(const std::string& filename){
 }
 
 GLuint Renderer::CreateShaderProgram(const std::string& vertexShaderSource, const std::string& fragmentShaderSource){
+    // A binary linked by an earlier launch skips everything below
+    uint64_t cacheKey = shaderCache.Key(vertexShaderSource, fragmentShaderSource);
+    GLuint cachedProgram = shaderCache.Load(cacheKey);
+    if (cachedProgram != 0) {
+        return cachedProgram;
+    }
+
     // Create a new program object
     GLuint programObject = glCreateProgram();
+    if (shaderCache.isEnabled()) {
+        glProgramParameteri(programObject, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    }
 
     // Compile our shaders
     GLuint myVertexShader   = CompileShader(GL_VERTEX_SHADER, vertexShaderSource);
@@ -65,6 +321,13 @@ GLuint Renderer::CreateShaderProgram(const std::string& vertexShaderSource, cons
     glAttachShader(programObject,myFragmentShader);
     glLinkProgram(programObject);
 
+    // Only programs that linked are worth keeping
+    GLint linked = GL_FALSE;
+    glGetProgramiv(programObject, GL_LINK_STATUS, &linked);
+    if (linked == GL_TRUE) {
+        shaderCache.Store(cacheKey, programObject);
+    }
+
     // Validate our program
     glValidateProgram(programObject);
 
@@ -126,11 +389,53 @@ GLuint Renderer::CompileShader(GLuint type, const std::string& source){
 }
 
 void Renderer::RenderScene() {
-    mainScene->InitializeGLuints();
+    UpdateFrameState();
     PreDraw();
-    DrawParticles(mainScene->getObjTotalIndices("Particle"));
-    //DrawLights(mainScene->getObjTotalIndices("Light"));
-    DrawBox(mainScene->getObjTotalIndices("Box"));
+    if (surfaceMeshMode) {
+        DrawSurfaceMesh();
+    }
+    else {
+        DrawParticles(particleMesh.totalIndices);
+    }
+    //DrawLights(lightMesh.totalIndices);
+    DrawBox(boxMesh.totalIndices);
+
+    historyValid = false; // the ray march history skips this frame
+}
+
+void Renderer::RenderScene_ScreenSpaceFluid(){
+    UpdateFrameState();
+    PreDraw();
+
+    // Remember where the frame is going (the window, or an offscreen target) so the composite can return to it
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &screenFramebuffer);
+    if (fluidTarget.depthFramebuffer == 0) {
+        CreateFluidTarget();
+    }
+
+    int numInstances = particleInstanceRing.Upload(renderPositions, snapshot->getRadii(), snapshot->getFlags());
+    DrawFluidSplats(numInstances);
+    SmoothFluidDepth();
+
+    glBindFramebuffer(GL_FRAMEBUFFER, screenFramebuffer);
+    glViewport(0, 0, screenWidth, screenHeight);
+    DrawFluidComposite();
+
+    DrawBox(boxMesh.totalIndices);
+
+    historyValid = false; // the ray march history skips this frame
+}
+
+void Renderer::UpdateFrameState(){
+    frameState.viewMatrix = mainScene->getCamera()->GetViewMatrix();
+    frameState.projection = projection;
+    frameState.viewPosition = mainScene->getCamera()->GetCameraEyePosition();
+    frameState.lightColor = glm::vec3(1.0f, 1.0f, 1.0f);
+    frameState.lightPosition = mainScene->getLights()[0]->getPosition();
+
+    glBindBuffer(GL_UNIFORM_BUFFER, frameStateBuffer);
+    glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(FrameState), &frameState);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
 }
 
 void Renderer::PreDraw() {
@@ -147,104 +452,93 @@ void Renderer::PreDraw() {
 } 
 
 void Renderer::DrawParticles(int gTotalIndices){
-    for (int i = 0; i < mainScene->getGVertexArrayObjects_map()["Particle"].size(); i++) {
-        PreDrawParticle(i);
-
-        // Update the View Matrix
-        GLint u_ViewMatrixLocation = glGetUniformLocation(gGraphicsPipelineShaderProgram,"u_ViewMatrix");
-        if(u_ViewMatrixLocation>=0){
-            glm::mat4 viewMatrix = mainScene->getCamera()->GetViewMatrix();
-            glUniformMatrix4fv(u_ViewMatrixLocation,1,GL_FALSE,&viewMatrix[0][0]);
-        }else{
-            std::cout << "Could not find u_ModelMatrix, maybe a mispelling?\n";
-            exit(EXIT_FAILURE);
-        }
+    // One instance per active particle, streamed as xyz = position, w = radius
+    int numInstances = particleInstanceRing.Upload(renderPositions, snapshot->getRadii(), snapshot->getFlags());
 
-        DrawParticle(i, gTotalIndices);
+    // Camera, projection and light all come from the FrameState block - nothing else to set per frame
+    if (impostorMode) {
+    	glUseProgram(gGraphicsImpostorPipelineShaderProgram);
+        DrawParticleImpostors(numInstances);
+    }
+    else {
+    	glUseProgram(gGraphicsPipelineShaderProgram);
+        DrawParticleInstances(gTotalIndices, numInstances);
     }
 }
 
-void Renderer::PreDrawParticle(int i){
-    // Use our shader
-	glUseProgram(gGraphicsPipelineShaderProgram);
-
-    // Model transformation by translating our object into world space
-    float r = mainScene->getSolver()->getParticles()[i]->getRadius();
-    glm::mat4 model = glm::translate(glm::mat4(1.0f), mainScene->getSolver()->getParticles()[i]->getPosition());
-    //model = glm::rotate(model, glm::radians(g_uRotate), glm::vec3(0.0f, 1.0f, 0.0f));
-    model = glm::scale(model, glm::vec3(r, r, r));
+void Renderer::DrawParticleInstances(int gTotalIndices, int numInstances){
+    // Every particle shares the one sphere mesh - only the instance attribute points at this frame's slot
+    glBindVertexArray(particleMesh.vertexArrayObject);
+    glBindBuffer(GL_ARRAY_BUFFER, particleInstanceRing.getCurrentBuffer());
+    glVertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE, sizeof(glm::vec4), (GLvoid*)0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
 
-	// Note: the error keeps showing up until you actually USE u_ModelMatrix in vert.glsl
-	GLint u_ModelMatrixLocation = glGetUniformLocation( gGraphicsPipelineShaderProgram,"u_ModelMatrix");
-    if(u_ModelMatrixLocation >=0){
-        glUniformMatrix4fv(u_ModelMatrixLocation,1,GL_FALSE,&model[0][0]);
-    }else{
-        std::cout << "Could not find u_ModelMatrix, maybe a mispelling?\n";
-        exit(EXIT_FAILURE);
-    }
+    glPolygonMode(GL_FRONT_AND_BACK, GL_FILL); 
+    glDrawElementsInstanced(GL_TRIANGLES,gTotalIndices,GL_UNSIGNED_INT,0,numInstances);
+    particleInstanceRing.FenceCurrentSlot();
 
-    GLint i_lightColor = glGetUniformLocation( gGraphicsPipelineShaderProgram,"i_lightColor");
-    if(i_lightColor >=0){
-        glUniform3fv(i_lightColor, 1, &glm::vec3(1.0f, 1.0f, 1.0f)[0]);
-    }else{
-        std::cout << "Could not find i_lightColor, maybe a mispelling?\n";
-        exit(EXIT_FAILURE);
-    }
+    glBindVertexArray(0);
+    glUseProgram(0);
+}
 
-    Particle* gLightParticle = mainScene->getLights()[0];
-    GLint i_lightPosition = glGetUniformLocation( gGraphicsPipelineShaderProgram,"i_lightPosition");
-    if(i_lightPosition >=0){
-        glUniform3fv(i_lightPosition, 1, &gLightParticle->getPosition()[0]);
-    }else{
-        std::cout << "Could not find i_lightPosition, maybe a mispelling?\n";
-        exit(EXIT_FAILURE);
-    }
+void Renderer::DrawParticleImpostors(int numInstances){
+    // Four vertices per particle instead of the whole sphere mesh - the fragment shader finds the exact surface
+    glBindVertexArray(gImpostorVertexArrayObject);
+    glBindBuffer(GL_ARRAY_BUFFER, particleInstanceRing.getCurrentBuffer());
+    glVertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE, sizeof(glm::vec4), (GLvoid*)0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
 
-    GLint i_viewPos = glGetUniformLocation( gGraphicsPipelineShaderProgram,"i_viewPos");
-    if(i_viewPos >=0){
-        glUniform3fv(i_viewPos, 1, &mainScene->getCamera()->GetCameraEyePosition()[0]);
-    }else{
-        std::cout << "Could not find i_viewPos, maybe a mispelling?\n";
-        exit(EXIT_FAILURE);
-    }
+    glPolygonMode(GL_FRONT_AND_BACK, GL_FILL); 
+    glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, numInstances);
+    particleInstanceRing.FenceCurrentSlot();
 
+    glBindVertexArray(0);
+    glUseProgram(0);
+}
 
-    // Projection matrix (in perspective) 
-    glm::mat4 perspective = glm::perspective(glm::radians(45.0f),
-                                             (float)screenWidth/(float)screenHeight,
-                                             0.1f,
-                                             10000.0f);
-	// Note: the error keeps showing up until you actually USE u_Projection in vert.glsl
-	GLint u_ProjectionLocation= glGetUniformLocation( gGraphicsPipelineShaderProgram,"u_Projection");
-    if(u_ProjectionLocation>=0){
-        glUniformMatrix4fv(u_ProjectionLocation,1,GL_FALSE,&perspective[0][0]);
-    }else{
-        std::cout << "Could not find u_Perspective, maybe a mispelling?\n";
-        exit(EXIT_FAILURE);
+void Renderer::DrawSurfaceMesh(){
+    surfaceExtractor.Extract(renderPositions, snapshot->getRadii(), snapshot->getFlags(), blendFactor);
+    const std::vector<glm::vec3>& positions = surfaceExtractor.getPositions();
+    const std::vector<glm::vec3>& normals = surfaceExtractor.getNormals();
+    const std::vector<uint32_t>& indices = surfaceExtractor.getIndices();
+    if (indices.empty()) return;
+
+    // Same vertex layout as the model meshes, in the ray marcher's fluid color
+    const glm::vec3 color = glm::vec3(0.0f, 0.5f, 0.8f);
+    surfaceVertexData.resize(positions.size() * 9);
+    for (size_t i = 0; i < positions.size(); i++) {
+        GLfloat* vertex = &surfaceVertexData[i * 9];
+        vertex[0] = positions[i].x;
+        vertex[1] = positions[i].y;
+        vertex[2] = positions[i].z;
+        vertex[3] = color.r;
+        vertex[4] = color.g;
+        vertex[5] = color.b;
+        vertex[6] = normals[i].x;
+        vertex[7] = normals[i].y;
+        vertex[8] = normals[i].z;
     }
-}
 
-void Renderer::DrawParticle(int i, int gTotalIndices){
-    glBindVertexArray(mainScene->getGVertexArrayObjects_map()["Particle"][i]);
-    glBindBuffer(GL_ARRAY_BUFFER, mainScene->getGVertexBufferObjects_map()["Particle"][i]);
+    // The mesh changes size every frame - orphan the old storage rather than wait for the GPU to finish with it
+    glBindVertexArray(gSurfaceVertexArrayObject);
+    glBindBuffer(GL_ARRAY_BUFFER, gSurfaceVertexBufferObject);
+    glBufferData(GL_ARRAY_BUFFER, surfaceVertexData.size() * sizeof(GLfloat), surfaceVertexData.data(), GL_STREAM_DRAW);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(uint32_t), indices.data(), GL_STREAM_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
 
-    glPolygonMode(GL_FRONT_AND_BACK, GL_FILL); 
-    glDrawElements(GL_TRIANGLES,gTotalIndices,GL_UNSIGNED_INT,0);
+    // The Phong vertex shader places every vertex at instance.xyz + instance.w * position: one instance at scale 1
+	glUseProgram(gGraphicsPipelineShaderProgram);
+    glVertexAttrib4f(3, 0.0f, 0.0f, 0.0f, 1.0f);
+    glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+    glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
+
+    glBindVertexArray(0);
     glUseProgram(0);
 }
 
 void Renderer::DrawLights(int gTotalIndices){
     PreDrawLight();
 
-    GLint u_ViewMatrixLocation = glGetUniformLocation(gGraphicsLighterPipelineShaderProgram,"u_ViewMatrix");
-    if(u_ViewMatrixLocation>=0){
-        glm::mat4 viewMatrix = mainScene->getCamera()->GetViewMatrix();
-        glUniformMatrix4fv(u_ViewMatrixLocation,1,GL_FALSE,&viewMatrix[0][0]);
-    }else{
-        std::cout << "Could not find u_ModelMatrix, maybe a mispelling?\n";
-        exit(EXIT_FAILURE);
-    }
-
     DrawLight(gTotalIndices);
 }
 
@@ -261,53 +555,20 @@ void Renderer::PreDrawLight() {
     model = glm::scale(model, glm::vec3(r, r, r));
 
 	// TA_README: Send data to GPU    
-	// Note: the error keeps showing up until you actually USE u_ModelMatrix in vert.glsl
-	GLint u_ModelMatrixLocation = glGetUniformLocation( gGraphicsLighterPipelineShaderProgram,"u_ModelMatrix");
-    if(u_ModelMatrixLocation >=0){
-        glUniformMatrix4fv(u_ModelMatrixLocation,1,GL_FALSE,&model[0][0]);
-    }else{
-        std::cout << "Could not find u_ModelMatrix, maybe a mispelling?\n";
-        exit(EXIT_FAILURE);
-    }
-
-    // Projection matrix (in perspective) 
-    glm::mat4 perspective = glm::perspective(glm::radians(45.0f),
-                                             (float)screenWidth/(float)screenHeight,
-                                             0.1f,
-                                             10000.0f);
-	// TA_README: Send data to GPU
-	// Note: the error keeps showing up until you actually USE u_Projection in vert.glsl
-	GLint u_ProjectionLocation= glGetUniformLocation( gGraphicsLighterPipelineShaderProgram,"u_Projection");
-    if(u_ProjectionLocation>=0){
-        glUniformMatrix4fv(u_ProjectionLocation,1,GL_FALSE,&perspective[0][0]);
-    }else{
-        std::cout << "Could not find u_Perspective, maybe a mispelling?\n";
-        exit(EXIT_FAILURE);
-    }
+    glUniformMatrix4fv(lighterUniforms.modelMatrix,1,GL_FALSE,&model[0][0]);
 }
 
 void Renderer::DrawLight(int gTotalIndices){
-    GLuint lightVertexArrayObject = mainScene->getGVertexArrayObjects_map()["Light"][0];
-    GLuint lightVertexBufferObject = mainScene->getGVertexBufferObjects_map()["Light"][0];
     glPolygonMode(GL_FRONT_AND_BACK, GL_FILL); 
-    glBindVertexArray(lightVertexArrayObject);
-    glBindBuffer(GL_ARRAY_BUFFER, lightVertexBufferObject);
+    glBindVertexArray(lightMesh.vertexArrayObject);
     glDrawElements(GL_TRIANGLES,gTotalIndices,GL_UNSIGNED_INT,0);
+    glBindVertexArray(0);
     glUseProgram(0);
 }
 
 void Renderer::DrawBox(int gBoxTotalIndices){
     PreDrawBox();
 
-    GLint u_ViewMatrixLocation = glGetUniformLocation(gGraphicsLighterPipelineShaderProgram,"u_ViewMatrix");
-    if(u_ViewMatrixLocation>=0){
-        glm::mat4 viewMatrix = mainScene->getCamera()->GetViewMatrix();
-        glUniformMatrix4fv(u_ViewMatrixLocation,1,GL_FALSE,&viewMatrix[0][0]);
-    }else{
-        std::cout << "Could not find u_ModelMatrix, maybe a mispelling?\n";
-        exit(EXIT_FAILURE);
-    }
-
     DrawBoxActually(gBoxTotalIndices);
 }
 
@@ -316,48 +577,57 @@ void Renderer::PreDrawBox(){
 	glUseProgram(gGraphicsLighterPipelineShaderProgram);
 
     // Model transformation by translating our object into world space
-    float r = 0.2f;
-    glm::mat4 model = mainScene->getBox()->getTransform();
-
-	// Note: the error keeps showing up until you actually USE u_ModelMatrix in vert.glsl
-	GLint u_ModelMatrixLocation = glGetUniformLocation( gGraphicsLighterPipelineShaderProgram,"u_ModelMatrix");
-    if(u_ModelMatrixLocation >=0){
-        glUniformMatrix4fv(u_ModelMatrixLocation,1,GL_FALSE,&model[0][0]);
-    }else{
-        std::cout << "Could not find u_ModelMatrix, maybe a mispelling?\n";
-        exit(EXIT_FAILURE);
-    }
-
-    // Projection matrix (in perspective) 
-    glm::mat4 perspective = glm::perspective(glm::radians(45.0f),
-                                             (float)screenWidth/(float)screenHeight,
-                                             0.1f,
-                                             10000.0f);
-	// Note: the error keeps showing up until you actually USE u_Projection in vert.glsl
-	GLint u_ProjectionLocation= glGetUniformLocation( gGraphicsLighterPipelineShaderProgram,"u_Projection");
-    if(u_ProjectionLocation>=0){
-        glUniformMatrix4fv(u_ProjectionLocation,1,GL_FALSE,&perspective[0][0]);
-    }else{
-        std::cout << "Could not find u_Perspective, maybe a mispelling?\n";
-        exit(EXIT_FAILURE);
-    }
+    glm::mat4 model = snapshot->boxTransform;
+    glUniformMatrix4fv(lighterUniforms.modelMatrix,1,GL_FALSE,&model[0][0]);
 }
 
 void Renderer::DrawBoxActually(int gBoxTotalIndices){
-    GLuint boxVertexArrayObject = mainScene->getGVertexArrayObjects_map()["Box"][0];
-    GLuint boxVertexBufferObject = mainScene->getGVertexArrayObjects_map()["Box"][0];
-
     glPolygonMode(GL_FRONT_AND_BACK, GL_FILL); 
-    glBindVertexArray(boxVertexArrayObject);
-    glBindBuffer(GL_ARRAY_BUFFER, boxVertexArrayObject);
+    glBindVertexArray(boxMesh.vertexArrayObject);
     glDrawElements(GL_TRIANGLES,gBoxTotalIndices,GL_UNSIGNED_INT,0);
+    glBindVertexArray(0);
     glUseProgram(0);
 }
 
 void Renderer::CleanUp(){
     glDeleteProgram(gGraphicsPipelineShaderProgram);
     glDeleteProgram(gGraphicsLighterPipelineShaderProgram);
-    glDeleteProgram(gGraphicsRayMarchingPipelineShaderProgram);
+    for (GLuint program : gGraphicsRayMarchingPermutationPrograms) {
+        glDeleteProgram(program);
+    }
+    glDeleteProgram(gGraphicsUpsamplePipelineShaderProgram);
+    glDeleteProgram(gGraphicsImpostorPipelineShaderProgram);
+    glDeleteProgram(gGraphicsFluidDepthPipelineShaderProgram);
+    glDeleteProgram(gGraphicsFluidThicknessPipelineShaderProgram);
+    glDeleteProgram(gGraphicsFluidSmoothPipelineShaderProgram);
+    glDeleteProgram(gGraphicsFluidCompositePipelineShaderProgram);
+    glDeleteBuffers(1, &gImpostorVertexBufferObject);
+    glDeleteVertexArrays(1, &gImpostorVertexArrayObject);
+    glDeleteBuffers(1, &gSurfaceVertexBufferObject);
+    glDeleteBuffers(1, &gSurfaceIndexBufferObject);
+    glDeleteVertexArrays(1, &gSurfaceVertexArrayObject);
+    glDeleteBuffers(1, &frameStateBuffer);
+
+    particleInstanceRing.CleanUp();
+    particleRing.CleanUp();
+    cellStartRing.CleanUp();
+    tileParticleRing.CleanUp();
+    tileStartRing.CleanUp();
+    glDeleteTextures(1, &volumeTexture);
+    glDeleteTextures(1, &transmittanceTexture);
+    particleMotionRing.CleanUp();
+    for (RayMarchTarget& target : rayMarchTargets) {
+        glDeleteTextures(1, &target.colorTexture);
+        glDeleteTextures(1, &target.geometryTexture);
+        glDeleteTextures(1, &target.motionTexture);
+        glDeleteFramebuffers(1, &target.framebuffer);
+    }
+    glDeleteFramebuffers(1, &fluidTarget.depthFramebuffer);
+    glDeleteFramebuffers(2, fluidTarget.smoothFramebuffers);
+    glDeleteFramebuffers(1, &fluidTarget.thicknessFramebuffer);
+    glDeleteTextures(2, fluidTarget.depthTextures);
+    glDeleteTextures(1, &fluidTarget.thicknessTexture);
+    glDeleteRenderbuffers(1, &fluidTarget.depthRenderbuffer);
 }
 
 void Renderer::VertexSpecification(){
@@ -400,17 +670,114 @@ void Renderer::VertexSpecification(){
 	glBindVertexArray(0);
 	glDisableVertexAttribArray(0);
 	glDisableVertexAttribArray(1);
+
+    // Handles of the scene's models, so draws never go through the model maps
+    particleMesh = mainScene->getMesh("Particle");
+    lightMesh = mainScene->getMesh("Light");
+    boxMesh = mainScene->getMesh("Box");
+
+    // One uniform buffer for the FrameState block of every program, refilled by UpdateFrameState()
+    glGenBuffers(1, &frameStateBuffer);
+    glBindBuffer(GL_UNIFORM_BUFFER, frameStateBuffer);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(FrameState), nullptr, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    glBindBufferBase(GL_UNIFORM_BUFFER, FRAME_STATE_BINDING, frameStateBuffer);
+
+    // Per-instance particle attribute on the shared particle mesh: the divisor makes it advance once per sphere
+    glBindVertexArray(particleMesh.vertexArrayObject);
+    glEnableVertexAttribArray(3);
+    glVertexAttribDivisor(3, 1);
+    glBindVertexArray(0);
+
+    // Impostor quad, corners in [-1, 1] as a triangle strip, plus the same per-instance attribute
+    const std::vector<GLfloat> impostorCorners{
+        -1.0f, -1.0f,
+        1.0f, -1.0f,
+        -1.0f, 1.0f,
+        1.0f, 1.0f
+    };
+    glGenVertexArrays(1, &gImpostorVertexArrayObject);
+    glBindVertexArray(gImpostorVertexArrayObject);
+    glGenBuffers(1, &gImpostorVertexBufferObject);
+    glBindBuffer(GL_ARRAY_BUFFER, gImpostorVertexBufferObject);
+    glBufferData(GL_ARRAY_BUFFER, impostorCorners.size() * sizeof(GLfloat), impostorCorners.data(), GL_STATIC_DRAW);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(GLfloat)*2, (void*)0);
+    glEnableVertexAttribArray(3);
+    glVertexAttribDivisor(3, 1);
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    // Extracted surface mesh: filled every frame by DrawSurfaceMesh(), attribute 3 is left off so it reads a constant
+    glGenVertexArrays(1, &gSurfaceVertexArrayObject);
+    glBindVertexArray(gSurfaceVertexArrayObject);
+    glGenBuffers(1, &gSurfaceVertexBufferObject);
+    glGenBuffers(1, &gSurfaceIndexBufferObject);
+    glBindBuffer(GL_ARRAY_BUFFER, gSurfaceVertexBufferObject);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, gSurfaceIndexBufferObject);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(GLfloat) * 9, (GLvoid*)0);
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(GLfloat) * 9, (GLvoid*)(sizeof(GLfloat) * 3));
+    glEnableVertexAttribArray(2);
+    glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, sizeof(GLfloat) * 9, (GLvoid*)(sizeof(GLfloat) * 6));
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    particleInstanceRing.Create();
+
+    particleRing.Create();
+    cellStartRing.Create(GL_R32I, sizeof(GLint));
+    tileParticleRing.Create(GL_R32I, sizeof(GLint));
+    tileStartRing.Create(GL_R32I, sizeof(GLint));
+    particleMotionRing.Create();
+
+    // Trilinear filtering does the interpolation between voxels for free
+    glGenTextures(1, &volumeTexture);
+    glBindTexture(GL_TEXTURE_3D, volumeTexture);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+
+    glGenTextures(1, &transmittanceTexture);
+    glBindTexture(GL_TEXTURE_3D, transmittanceTexture);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_3D, 0);
+
+    GLint max3DTextureSize = 0;
+    glGetIntegerv(GL_MAX_3D_TEXTURE_SIZE, &max3DTextureSize);
+    if (particleVolume.getResolution() > max3DTextureSize) {
+        std::cout << "Volume resolution " << particleVolume.getResolution() << " exceeds GL_MAX_3D_TEXTURE_SIZE, using " << max3DTextureSize << "\n";
+        particleVolume.setResolution(max3DTextureSize);
+    }
 }
 
 void Renderer::RenderScene_RayMarch(){
-    mainScene->InitializeGLuints();
+    UpdateFrameState();
 
     PreDraw();
 
-    PreDraw_RM();
-    Draw_RM(); // Draw raymarched particles on top
+    if (rayMarchScale < 1.0f || temporalMode) {
+        // March offscreen (fewer pixels, and/or keeping history), then upsample onto the screen
+        BeginRayMarchTarget();
+        PreDraw_RM();
+        Draw_RM(); // Draw raymarched particles on top
+        UpsampleRayMarchTarget();
+    }
+    else {
+        rayMarchWidth = screenWidth;
+        rayMarchHeight = screenHeight;
+        PreDraw_RM();
+        Draw_RM(); // Draw raymarched particles on top
+    }
 
-    DrawBox(mainScene->getObjTotalIndices("Box")); // Draw the box first
+    DrawBox(boxMesh.totalIndices); // Draw the box first
 
 }
 
@@ -419,32 +786,353 @@ void Renderer::PreDraw_RM(){
     // Use our shader
 	glUseProgram(gGraphicsRayMarchingPipelineShaderProgram);
 
-    GLint locResolution = glGetUniformLocation(gGraphicsRayMarchingPipelineShaderProgram, "iResolution");
-    glUniform2f(locResolution, (float)screenWidth, (float)screenHeight);
+    // Camera position and rotation come from the FrameState block
+    glUniform2f(rayMarchUniforms.iResolution, (float)rayMarchWidth, (float)rayMarchHeight);
+
+    float time = SDL_GetTicks() / 1000.0f;
+    glUniform1f(rayMarchUniforms.iTime, time);
+
+    // Send shader particle info - only active particles, with their radii, sorted into a uniform grid
+    particleGrid.Build(renderPositions, snapshot->getRadii(), snapshot->getFlags(), blendFactor);
+    int numParticles = particleGrid.getParticleCount();
+    glUniform1i(rayMarchUniforms.particleCount, numParticles);
+
+    // The surface can sit up to a radius plus the blend outside a particle center, the density one band further
+    float fluidPadding = particleGrid.getMaxRadius() + std::max(blendFactor, ParticleVolume::DENSITY_BAND);
+    glm::vec3 fluidBoundsMin = particleGrid.getBoundsMin() - glm::vec3(fluidPadding);
+    glm::vec3 fluidBoundsMax = particleGrid.getBoundsMax() + glm::vec3(fluidPadding);
+    glUniform3fv(rayMarchUniforms.fluidBoundsMin, 1, &fluidBoundsMin[0]);
+    glUniform3fv(rayMarchUniforms.fluidBoundsMax, 1, &fluidBoundsMax[0]);
+
+    const std::vector<glm::vec4>& sortedParticles = particleGrid.getSortedParticles();
+    const std::vector<int>& cellStarts = particleGrid.getCellStarts();
+
+    // Texture buffers hold at most GL_MAX_TEXTURE_BUFFER_SIZE texels - GL 4.1 only guarantees 65536 - so a frame whose
+    // particle, cell or tile lists would be cut short is marched through the baked volume instead
+    // --> Temporal mode needs the particles' motion to reproject, so it always takes the per-particle path when it can
+    volumeThisFrame = useVolume && !temporalMode;
+    if (!volumeThisFrame) {
+        // Per 16x16 tile lists of the particles whose blend-inflated sphere reaches into the tile
+        tileCuller.Build(sortedParticles, frameState.viewMatrix, projection, rayMarchWidth, rayMarchHeight,
+                         std::max(blendFactor, ParticleVolume::DENSITY_BAND));
+        size_t maxTexels = particleRing.getMaxParticles() > 0 ? (size_t)particleRing.getMaxParticles() : SIZE_MAX;
+        size_t largestList = std::max(std::max(sortedParticles.size(), cellStarts.size()),
+                                      std::max(tileCuller.getTileParticles().size(), tileCuller.getTileStarts().size()));
+        volumeThisFrame = largestList > maxTexels;
+        if (volumeThisFrame && !particleListsOverflowed) {
+            std::cout << "Ray march: " << largestList << " texels exceed GL_MAX_TEXTURE_BUFFER_SIZE (" << maxTexels
+                      << "), marching the baked volume (" << particleVolume.getResolution() << " voxels) instead\n";
+        }
+        particleListsOverflowed = volumeThisFrame;
+    }
+    glUniform1i(rayMarchUniforms.useVolume, volumeThisFrame);
+
+    // Reproject from the other target only when it really holds last frame, and never a volume frame: the volume has no
+    // particle motion, so its history would only follow the camera and smear moving fluid
+    bool reproject = temporalMode && historyValid && !volumeThisFrame;
+    glUniform1i(rayMarchUniforms.temporalMode, reproject);
+    glUniform1i(rayMarchUniforms.temporalPhase, temporalPhase);
+    if (reproject) {
+        const RayMarchTarget& history = rayMarchTargets[1 - currentRayMarchTarget];
+        glActiveTexture(GL_TEXTURE5);
+        glBindTexture(GL_TEXTURE_2D, history.colorTexture);
+        glActiveTexture(GL_TEXTURE6);
+        glBindTexture(GL_TEXTURE_2D, history.geometryTexture);
+        glActiveTexture(GL_TEXTURE7);
+        glBindTexture(GL_TEXTURE_2D, history.motionTexture);
+        glActiveTexture(GL_TEXTURE0);
+        glUniformMatrix4fv(rayMarchUniforms.previousViewProjection, 1, GL_FALSE, &previousViewProjection[0][0]);
+        glUniform3fv(rayMarchUniforms.previousCameraPosition, 1, &previousCameraPosition[0]);
+    }
 
-    GLint locCamPos = glGetUniformLocation(gGraphicsRayMarchingPipelineShaderProgram, "cameraPosition");
-    glm::vec3 camPos = mainScene->getCamera()->GetCameraEyePosition();
-    glUniform3fv(locCamPos, 1, &camPos[0]);
+    // The shadow grid is marched through the baked density, so it is only built when the volume is baked anyway -
+    // baking one just for shadows would cost more than the per-particle march it sits next to
+    bool shadows = lightShadows && volumeThisFrame;
+    glUniform1i(rayMarchUniforms.useLightShadows, shadows);
+    if (volumeThisFrame) {
+        particleVolume.Build(particleGrid);
+        if (shadows) {
+            UploadLightTransmittance();
+        }
+        UploadVolume();
+        previousRenderPositions.clear(); // the next per-particle frame must not diff against positions from before this one
+        return;
+    }
 
-    GLint locCamRot = glGetUniformLocation(gGraphicsRayMarchingPipelineShaderProgram, "cameraRotation");
-    glm::vec3 forward = glm::normalize(glm::vec3(0.0f,0.0f, -1.0f));
-    glm::vec3 right   = glm::normalize(glm::cross(forward, glm::vec3(0.0f, 1.0f, 0.0f)));
-    glm::vec3 up      = glm::cross(right, forward);
-    glm::mat3 cameraRotation(right, up, -forward);
-    glUniformMatrix3fv(locCamRot, 1, GL_FALSE, &cameraRotation[0][0]);
+    particleRing.UploadTexels(sortedParticles.data(), sortedParticles.size());
+    cellStartRing.UploadTexels(cellStarts.data(), cellStarts.size());
+    particleRing.Bind(0);
+    cellStartRing.Bind(1);
+
+    const std::vector<int>& tileParticles = tileCuller.getTileParticles();
+    const std::vector<int>& tileStarts = tileCuller.getTileStarts();
+    tileParticleRing.UploadTexels(tileParticles.data(), tileParticles.size());
+    tileStartRing.UploadTexels(tileStarts.data(), tileStarts.size());
+    tileParticleRing.Bind(3);
+    tileStartRing.Bind(4);
+    glm::ivec2 tileCounts = tileCuller.getTileCounts();
+    glUniform2iv(rayMarchUniforms.tileCounts, 1, &tileCounts[0]);
+
+    // Per particle movement since last frame, so reprojection can follow the fluid and not just the camera
+    if (temporalMode) {
+        const std::vector<int>& sortedSource = particleGrid.getSortedSource();
+        sortedMotion.resize(sortedSource.size());
+        bool samePositions = previousRenderPositions.size() == renderPositions.size();
+        for (size_t i = 0; i < sortedSource.size(); i++) {
+            int source = sortedSource[i];
+            sortedMotion[i] = samePositions ? glm::vec4(renderPositions[source] - previousRenderPositions[source], 0.0f) : glm::vec4(0.0f);
+        }
+        previousRenderPositions.assign(renderPositions.begin(), renderPositions.end());
+        particleMotionRing.UploadTexels(sortedMotion.data(), sortedMotion.size());
+        particleMotionRing.Bind(8);
+    }
+    else {
+        previousRenderPositions.clear();
+    }
 
-    float time = SDL_GetTicks() / 1000.0f;
-    glUniform1f(glGetUniformLocation(gGraphicsRayMarchingPipelineShaderProgram, "iTime"), time);
+    glm::vec3 gridOrigin = particleGrid.getOrigin();
+    glm::ivec3 gridDims = particleGrid.getDims();
+    glUniform3fv(rayMarchUniforms.gridOrigin, 1, &gridOrigin[0]);
+    glUniform3iv(rayMarchUniforms.gridDims, 1, &gridDims[0]);
+    glUniform1f(rayMarchUniforms.cellSize, particleGrid.getCellSize());
+    glUniform1f(rayMarchUniforms.maxRadius, particleGrid.getMaxRadius());
+}
+
+void Renderer::UploadVolume(){
+    glm::ivec3 dims = particleVolume.getDims();
+    const std::vector<glm::vec2>& voxels = particleVolume.getVoxels();
+
+    glActiveTexture(GL_TEXTURE2);
+    glBindTexture(GL_TEXTURE_3D, volumeTexture);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    if (dims != volumeTextureDims) {
+        // Particle bounds changed shape - reallocate, otherwise just overwrite the texels in place
+        glTexImage3D(GL_TEXTURE_3D, 0, GL_RG32F, dims.x, dims.y, dims.z, 0, GL_RG, GL_FLOAT, voxels.data());
+        volumeTextureDims = dims;
+    }
+    else {
+        glTexSubImage3D(GL_TEXTURE_3D, 0, 0, 0, 0, dims.x, dims.y, dims.z, GL_RG, GL_FLOAT, voxels.data());
+    }
+    glActiveTexture(GL_TEXTURE0);
+
+    glm::vec3 volumeOrigin = particleVolume.getOrigin();
+    glUniform3fv(rayMarchUniforms.volumeOrigin, 1, &volumeOrigin[0]);
+    glUniform1f(rayMarchUniforms.voxelSize, particleVolume.getVoxelSize());
+}
+
+void Renderer::UploadLightTransmittance(){
+    lightTransmittance.Build(particleVolume, frameState.lightPosition);
+
+    glm::ivec3 dims = lightTransmittance.getDims();
+    const std::vector<float>& transmittance = lightTransmittance.getTransmittance();
+
+    glActiveTexture(GL_TEXTURE9);
+    glBindTexture(GL_TEXTURE_3D, transmittanceTexture);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    if (dims != transmittanceTextureDims) {
+        glTexImage3D(GL_TEXTURE_3D, 0, GL_R32F, dims.x, dims.y, dims.z, 0, GL_RED, GL_FLOAT, transmittance.data());
+        transmittanceTextureDims = dims;
+    }
+    else {
+        glTexSubImage3D(GL_TEXTURE_3D, 0, 0, 0, 0, dims.x, dims.y, dims.z, GL_RED, GL_FLOAT, transmittance.data());
+    }
+    glActiveTexture(GL_TEXTURE0);
+
+    glm::vec3 transmittanceOrigin = lightTransmittance.getOrigin();
+    glUniform3fv(rayMarchUniforms.transmittanceOrigin, 1, &transmittanceOrigin[0]);
+    glUniform1f(rayMarchUniforms.transmittanceVoxelSize, lightTransmittance.getVoxelSize());
+}
+
+void Renderer::BeginRayMarchTarget(){
+    // Remember where the frame is going (the window, or an offscreen target) so the upsample can return to it
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &screenFramebuffer);
 
-    // Send shader particle info
-    int numParticles = mainScene->getSolver()->getParticles().size();
-    std::vector<glm::vec3> positions;
-    for (int i = 0; i < numParticles; i++) {
-        positions.push_back(mainScene->getSolver()->getParticles()[i]->getPosition());
+    rayMarchWidth = std::max(1, (int)(screenWidth * rayMarchScale + 0.5f));
+    rayMarchHeight = std::max(1, (int)(screenHeight * rayMarchScale + 0.5f));
+
+    if (rayMarchTargetSize != glm::ivec2(rayMarchWidth, rayMarchHeight)) {
+        // Scale changed - reallocate both targets; the history is at the old size, so it cannot be reused
+        for (RayMarchTarget& target : rayMarchTargets) {
+            CreateRayMarchTarget(target);
+        }
+        rayMarchTargetSize = glm::ivec2(rayMarchWidth, rayMarchHeight);
+        historyValid = false;
+    }
+
+    glBindFramebuffer(GL_FRAMEBUFFER, rayMarchTargets[currentRayMarchTarget].framebuffer);
+    glViewport(0, 0, rayMarchWidth, rayMarchHeight);
+
+    // Hit distance 0 marks texels where the ray missed
+    const GLfloat clearValue[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+    glClearBufferfv(GL_COLOR, 0, clearValue);
+    glClearBufferfv(GL_COLOR, 1, clearValue);
+    glClearBufferfv(GL_COLOR, 2, clearValue);
+}
+
+void Renderer::CreateRayMarchTarget(RayMarchTarget& target){
+    if (target.framebuffer == 0) {
+        glGenFramebuffers(1, &target.framebuffer);
+        glGenTextures(1, &target.colorTexture);
+        glGenTextures(1, &target.geometryTexture);
+        glGenTextures(1, &target.motionTexture);
+    }
+
+    // The upsample and the reprojection read texels directly, so no filtering or mipmaps
+    GLuint textures[3] = {target.colorTexture, target.geometryTexture, target.motionTexture};
+    GLenum formats[3] = {GL_RGBA8, GL_RGBA32F, GL_RGBA16F};
+    for (int i = 0; i < 3; i++) {
+        glBindTexture(GL_TEXTURE_2D, textures[i]);
+        glTexImage2D(GL_TEXTURE_2D, 0, formats[i], rayMarchWidth, rayMarchHeight, 0, GL_RGBA, GL_FLOAT, nullptr);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    }
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, target.framebuffer);
+    GLenum drawBuffers[3] = {GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1, GL_COLOR_ATTACHMENT2};
+    for (int i = 0; i < 3; i++) {
+        glFramebufferTexture2D(GL_FRAMEBUFFER, drawBuffers[i], GL_TEXTURE_2D, textures[i], 0);
+    }
+    glDrawBuffers(3, drawBuffers);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        std::cout << "Ray march framebuffer is incomplete\n";
+        exit(EXIT_FAILURE);
+    }
+}
+
+void Renderer::UpsampleRayMarchTarget(){
+    glBindFramebuffer(GL_FRAMEBUFFER, screenFramebuffer);
+    glViewport(0, 0, screenWidth, screenHeight);
+
+	glUseProgram(gGraphicsUpsamplePipelineShaderProgram);
+
+    const RayMarchTarget& target = rayMarchTargets[currentRayMarchTarget];
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, target.colorTexture);
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, target.geometryTexture);
+    glActiveTexture(GL_TEXTURE0);
+
+    glBindVertexArray(gVertexArrayObject);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glUseProgram(0);
+
+    if (temporalMode) {
+        // This frame becomes the history for the next one, which marches the next pixel of every 2x2 block
+        previousViewProjection = projection * frameState.viewMatrix;
+        previousCameraPosition = frameState.viewPosition;
+        currentRayMarchTarget = 1 - currentRayMarchTarget;
+        temporalPhase = (temporalPhase + 1) % 4;
+        historyValid = true;
+    }
+}
+
+void Renderer::CreateFluidTarget(){
+    glGenFramebuffers(1, &fluidTarget.depthFramebuffer);
+    glGenFramebuffers(2, fluidTarget.smoothFramebuffers);
+    glGenFramebuffers(1, &fluidTarget.thicknessFramebuffer);
+    glGenTextures(2, fluidTarget.depthTextures);
+    glGenTextures(1, &fluidTarget.thicknessTexture);
+    glGenRenderbuffers(1, &fluidTarget.depthRenderbuffer);
+
+    // Every pass reads texels directly, so no filtering or mipmaps
+    GLuint textures[3] = {fluidTarget.depthTextures[0], fluidTarget.depthTextures[1], fluidTarget.thicknessTexture};
+    GLenum formats[3] = {GL_R32F, GL_R32F, GL_R16F};
+    for (int i = 0; i < 3; i++) {
+        glBindTexture(GL_TEXTURE_2D, textures[i]);
+        glTexImage2D(GL_TEXTURE_2D, 0, formats[i], screenWidth, screenHeight, 0, GL_RED, GL_FLOAT, nullptr);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
     }
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    glBindRenderbuffer(GL_RENDERBUFFER, fluidTarget.depthRenderbuffer);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, screenWidth, screenHeight);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+    GLuint framebuffers[4] = {fluidTarget.depthFramebuffer, fluidTarget.smoothFramebuffers[0], fluidTarget.smoothFramebuffers[1], fluidTarget.thicknessFramebuffer};
+    GLuint attachments[4] = {fluidTarget.depthTextures[0], fluidTarget.depthTextures[0], fluidTarget.depthTextures[1], fluidTarget.thicknessTexture};
+    for (int i = 0; i < 4; i++) {
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffers[i]);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, attachments[i], 0);
+        if (framebuffers[i] == fluidTarget.depthFramebuffer) {
+            glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, fluidTarget.depthRenderbuffer);
+        }
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+            std::cout << "Screen-space fluid framebuffer is incomplete\n";
+            exit(EXIT_FAILURE);
+        }
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, screenFramebuffer);
+}
+
+void Renderer::DrawFluidSplats(int numInstances){
+    const GLfloat clearValue[4] = {0.0f, 0.0f, 0.0f, 0.0f};
 
-    glUniform1i(glGetUniformLocation(gGraphicsRayMarchingPipelineShaderProgram, "particleCount"), numParticles);
-    glUniform3fv(glGetUniformLocation(gGraphicsRayMarchingPipelineShaderProgram, "particlePositions"), numParticles, &positions[0].x);
+    // Nearest sphere front per pixel, depth tested against the other spheres
+    glBindFramebuffer(GL_FRAMEBUFFER, fluidTarget.depthFramebuffer);
+    glViewport(0, 0, screenWidth, screenHeight);
+    glClearBufferfv(GL_COLOR, 0, clearValue);
+    glClear(GL_DEPTH_BUFFER_BIT);
+	glUseProgram(gGraphicsFluidDepthPipelineShaderProgram);
+    DrawParticleImpostors(numInstances);
+
+    // Every sphere's chord added up, front or back
+    glBindFramebuffer(GL_FRAMEBUFFER, fluidTarget.thicknessFramebuffer);
+    glClearBufferfv(GL_COLOR, 0, clearValue);
+    glDisable(GL_DEPTH_TEST);
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_ONE, GL_ONE);
+	glUseProgram(gGraphicsFluidThicknessPipelineShaderProgram);
+    DrawParticleImpostors(numInstances);
+    glDisable(GL_BLEND);
+}
+
+void Renderer::SmoothFluidDepth(){
+	glUseProgram(gGraphicsFluidSmoothPipelineShaderProgram);
+    glUniform1f(fluidSmoothUniforms.smoothingRadius, fluidSmoothingRadius);
+    glUniform1f(fluidSmoothUniforms.projectionScale, projection[1][1] * 0.5f * screenHeight);
+    glBindVertexArray(gVertexArrayObject);
+
+    // Horizontal pass into depthTextures[1], vertical pass back into depthTextures[0]
+    glActiveTexture(GL_TEXTURE0);
+    for (int i = 0; i < fluidSmoothingIterations; i++) {
+        for (int axis = 0; axis < 2; axis++) {
+            glBindFramebuffer(GL_FRAMEBUFFER, fluidTarget.smoothFramebuffers[1 - axis]);
+            glBindTexture(GL_TEXTURE_2D, fluidTarget.depthTextures[axis]);
+            glUniform2i(fluidSmoothUniforms.direction, 1 - axis, axis);
+            glDrawArrays(GL_TRIANGLES, 0, 3);
+        }
+    }
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    glBindVertexArray(0);
+    glUseProgram(0);
+}
+
+void Renderer::DrawFluidComposite(){
+    // Writes the smoothed surface's depth, so the box is depth tested against the fluid
+    glEnable(GL_DEPTH_TEST);
+	glUseProgram(gGraphicsFluidCompositePipelineShaderProgram);
+
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, fluidTarget.depthTextures[0]);
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, fluidTarget.thicknessTexture);
+
+    glBindVertexArray(gVertexArrayObject);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+    glBindVertexArray(0);
+
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glUseProgram(0);
 }
 
 void Renderer::Draw_RM(){
@@ -459,6 +1147,17 @@ void Renderer::Draw_RM(){
     //Render data
     glDrawArrays(GL_TRIANGLES, 0, 3);
 
+    // The particle slots may be rewritten once the GPU has finished this draw
+    if (!volumeThisFrame) {
+        particleRing.FenceCurrentSlot();
+        cellStartRing.FenceCurrentSlot();
+        tileParticleRing.FenceCurrentSlot();
+        tileStartRing.FenceCurrentSlot();
+        if (temporalMode) {
+            particleMotionRing.FenceCurrentSlot();
+        }
+    }
+
     // Stop using our current graphics pipeline
     // Note: This is not necessary if we only have one graphics pipeline.
     glUseProgram(0);
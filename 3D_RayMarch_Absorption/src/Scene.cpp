@@ -25,12 +25,14 @@ void Scene::updateBoxRotationZ(float val) {
 
 void Scene::SetupScene(int numParticles, float size){
     SetupSolverLightsAndContainer(numParticles, size);
-    gModelProcessor->VertexSpecification(gSolver->getParticles().size());
+    gModelProcessor->VertexSpecification();
 }
 
-void Scene::SetupSceneWithCuboidSetup(int w, int b, int h, float r){
+void Scene::SetupSceneWithCuboidSetup(int w, int b, int h, float r, bool uploadModels){
     SetupCuboidSolverLightsAndContainer(w, b, h, r);
-    gModelProcessor->VertexSpecification(gSolver->getParticles().size());
+    if (uploadModels) {
+        gModelProcessor->VertexSpecification();
+    }
     cuboidSolverSetup = true;
 }
 
@@ -48,9 +50,7 @@ void Scene::SetupCuboidSolverLightsAndContainer(int w, int b, int h, float r){
 }
 
 void Scene::SetUpSolver(int numParticles, float size){
-    for (int i = 0; i < numParticles; i++) {
-        gSolver->addParticle(glm::vec3(0.0f,6.0f,0.0f), size, false);
-    }
+    gSolver->addParticles(numParticles, [](int) { return glm::vec3(0.0f,6.0f,0.0f); }, size, false);
 }
 
 void Scene::SetUpCuboidSolver(int w, int b, int h, float r) {
@@ -69,14 +69,15 @@ void Scene::SetUpCuboidSolver(int w, int b, int h, float r) {
         -totalBreadth / 2.0f
     );
 
-    for (int i = 0; i < w; ++i) {
-        for (int j = 0; j < h; ++j) {
-            for (int k = 0; k < b; ++k) {
-                glm::vec3 pos = origin + glm::vec3(i * spacing, j * spacing, k * spacing);
-                gSolver->addParticle(pos, r, true);
-            }
-        }
-    }
+    // Particle n sits at (i, j, k) with k varying fastest, then j, then i
+    auto positionAt = [=](int n) {
+        int k = n % b;
+        int j = (n / b) % h;
+        int i = n / (b * h);
+        return origin + glm::vec3(i * spacing, j * spacing, k * spacing);
+    };
+
+    gSolver->addParticles(w * h * b, positionAt, r, true);
 }
 
 void Scene::SetUpLights(){
@@ -87,13 +88,6 @@ void Scene::addLight(glm::vec3 position, float radius) {
     lights.push_back(new Particle(position, radius));
 }
 
-// vvvvvvvvvvvvvvvvvvvvvvvvvv Set Functions vvvvvvvvvvvvvvvvvvvvvvvvvv
-
-void Scene::InitializeGLuints(){
-    gVertexArrayObjects_map = gModelProcessor->getGVertexArrayObjects_map();
-    gVertexBufferObjects_map = gModelProcessor->getGVertexBufferObjects_map();
-}
-
 // vvvvvvvvvvvvvvvvvvvvvvvvvv Get Functions vvvvvvvvvvvvvvvvvvvvvvvvvv
 
 std::vector<Particle*> Scene::getLights(){
@@ -108,16 +102,8 @@ Camera* Scene::getCamera(){
     return gCamera;
 }
 
-std::unordered_map<std::string, std::vector<GLuint>> Scene::getGVertexArrayObjects_map(){
-    return gVertexArrayObjects_map;
-}
-
-std::unordered_map<std::string, std::vector<GLuint>> Scene::getGVertexBufferObjects_map(){
-    return gVertexBufferObjects_map;
-}
-
-int Scene::getObjTotalIndices(std::string objName){
-    return gModelProcessor->getObjTotalIndices(objName);
+MeshHandles Scene::getMesh(const std::string& objName){
+    return gModelProcessor->getMesh(objName);
 }
 
 Container* Scene::getBox(){
@@ -0,0 +1,113 @@
+#include "ShaderCache.hpp"
+
+// Entry layout: this header, then the driver's binary
+struct ProgramBinaryHeader{
+    char magic[4];
+    uint32_t version;
+    uint64_t key; // repeated from the file name, in case files are renamed or copied around
+    uint32_t binaryFormat;
+    uint32_t length;
+};
+static const char PROGRAM_BINARY_MAGIC[4] = {'P', 'S', 'H', 'B'};
+static const uint32_t PROGRAM_BINARY_VERSION = 1;
+
+ShaderCache::ShaderCache(){
+    enabled = false;
+    hits = 0;
+    misses = 0;
+}
+
+void ShaderCache::Initialize(){
+    GLint numFormats = 0;
+    if (GLAD_GL_ARB_get_program_binary) {
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &numFormats);
+    }
+    enabled = numFormats > 0;
+    if (!enabled) return;
+
+    driver = std::string((const char*)glGetString(GL_VENDOR)) + "|" + (const char*)glGetString(GL_RENDERER) + "|" +
+             (const char*)glGetString(GL_VERSION);
+
+    directory = BasePath() + "shader_cache/";
+    std::error_code error;
+    std::filesystem::create_directories(directory, error);
+    if (error) {
+        std::cout << "Shader cache disabled, could not create " << directory << "\n";
+        enabled = false;
+    }
+}
+
+bool ShaderCache::isEnabled(){
+    return enabled;
+}
+
+uint64_t ShaderCache::Key(const std::string& vertexSource, const std::string& fragmentSource){
+    std::string keySource = vertexSource + '\0' + fragmentSource + '\0' + driver;
+    return HashBytes(keySource.data(), keySource.size());
+}
+
+std::string ShaderCache::EntryPath(uint64_t key){
+    char name[32];
+    snprintf(name, sizeof(name), "%016llx.bin", (unsigned long long)key);
+    return directory + name;
+}
+
+GLuint ShaderCache::Load(uint64_t key){
+    if (!enabled) {
+        misses++;
+        return 0;
+    }
+
+    MappedFile file;
+    if (!file.Open(EntryPath(key)) || file.getSize() < sizeof(ProgramBinaryHeader)) {
+        misses++;
+        return 0;
+    }
+    ProgramBinaryHeader header;
+    memcpy(&header, file.getData(), sizeof(header));
+    if (memcmp(header.magic, PROGRAM_BINARY_MAGIC, 4) != 0 || header.version != PROGRAM_BINARY_VERSION ||
+        header.key != key || file.getSize() != sizeof(header) + header.length) {
+        misses++;
+        return 0;
+    }
+
+    GLuint program = glCreateProgram();
+    glProgramBinary(program, header.binaryFormat, file.getData() + sizeof(header), header.length);
+    GLint linked = GL_FALSE;
+    glGetProgramiv(program, GL_LINK_STATUS, &linked);
+    if (linked == GL_FALSE) {
+        glDeleteProgram(program);
+        misses++;
+        return 0;
+    }
+    hits++;
+    return program;
+}
+
+void ShaderCache::Store(uint64_t key, GLuint program){
+    if (!enabled) return;
+
+    GLint length = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0) return;
+    std::vector<char> binary(length);
+    GLenum binaryFormat = 0;
+    glGetProgramBinary(program, length, &length, &binaryFormat, binary.data());
+
+    ProgramBinaryHeader header;
+    memcpy(header.magic, PROGRAM_BINARY_MAGIC, 4);
+    header.version = PROGRAM_BINARY_VERSION;
+    header.key = key;
+    header.binaryFormat = binaryFormat;
+    header.length = length;
+
+    WriteFileAtomic(EntryPath(key), {{&header, sizeof(header)}, {binary.data(), (size_t)length}});
+}
+
+int ShaderCache::getHitCount(){
+    return hits;
+}
+
+int ShaderCache::getMissCount(){
+    return misses;
+}
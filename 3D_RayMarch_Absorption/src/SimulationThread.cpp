@@ -0,0 +1,129 @@
+#include "SimulationThread.hpp"
+
+SimulationThread::SimulationThread(Solver* i_solver, Scene* i_scene){
+    solver = i_solver;
+    scene = i_scene;
+    running = false;
+    paused = false;
+    pendingBoxRotationZ = 0.0f;
+}
+
+SimulationThread::~SimulationThread(){
+    stop();
+}
+
+void SimulationThread::start(){
+    if (running) return;
+
+    // The renderer must have something to draw before the first solver frame completes
+    publishSnapshot(std::chrono::steady_clock::now());
+
+    running = true;
+    worker = std::thread(&SimulationThread::run, this);
+}
+
+void SimulationThread::stop(){
+    {
+        std::lock_guard<std::mutex> lock(stateMutex);
+        running = false;
+    }
+    stateChanged.notify_all();
+
+    if (worker.joinable()) {
+        worker.join();
+    }
+}
+
+void SimulationThread::setPaused(bool i_paused){
+    {
+        std::lock_guard<std::mutex> lock(stateMutex);
+        paused = i_paused;
+    }
+    stateChanged.notify_all();
+}
+
+void SimulationThread::requestParticleActivation(int index){
+    std::lock_guard<std::mutex> lock(stateMutex);
+    pendingActivations.push_back(index);
+}
+
+void SimulationThread::requestBoxRotationZ(float val){
+    std::lock_guard<std::mutex> lock(stateMutex);
+    pendingBoxRotationZ += val;
+}
+
+const ParticleSnapshot& SimulationThread::getLatestSnapshot(){
+    return snapshots.acquireLatest();
+}
+
+void SimulationThread::run(){
+    using clock = std::chrono::steady_clock;
+
+    // Fixed timestep: wall-clock time accumulates, the solver consumes it in step_dt chunks
+    auto stepDuration = std::chrono::duration_cast<clock::duration>(std::chrono::duration<float>(solver->getStepDt()));
+    auto stepTime = clock::now(); // wall-clock time the last solver frame corresponds to
+
+    while (running) {
+        {
+            std::unique_lock<std::mutex> lock(stateMutex);
+            if (paused) {
+                stateChanged.wait(lock, [this] { return !paused || !running; });
+                stepTime = clock::now(); // time spent paused is not simulated
+            }
+        }
+        if (!running) break;
+
+        auto now = clock::now();
+        if (now - stepTime > stepDuration * MAX_CATCH_UP_STEPS) {
+            // The solver cannot keep up - drop the backlog rather than fall further behind every frame
+            stepTime = now - stepDuration * MAX_CATCH_UP_STEPS;
+        }
+
+        while (now - stepTime >= stepDuration && running) {
+            stepTime += stepDuration;
+
+            applyPendingRequests();
+            solver->update(scene->getBox(), solver->getFrameCount());
+
+            publishSnapshot(stepTime);
+        }
+
+        // Wait for the next step to come due - this only paces the simulation thread, never the renderer
+        std::this_thread::sleep_until(stepTime + stepDuration);
+    }
+}
+
+void SimulationThread::applyPendingRequests(){
+    std::vector<int> activations;
+    float boxRotationZ;
+    {
+        std::lock_guard<std::mutex> lock(stateMutex);
+        activations.swap(pendingActivations);
+        boxRotationZ = pendingBoxRotationZ;
+        pendingBoxRotationZ = 0.0f;
+    }
+
+    for (int index : activations) {
+        solver->activateNewParticle(index);
+    }
+    if (boxRotationZ != 0.0f) {
+        scene->updateBoxRotationZ(boxRotationZ);
+    }
+}
+
+void SimulationThread::publishSnapshot(std::chrono::steady_clock::time_point stepTime){
+    ParticleSnapshot& snapshot = snapshots.beginWrite();
+    solver->writeSnapshot(snapshot);
+
+    // The very first snapshot has nothing before it, so it interpolates against itself
+    if (lastPublishedPositions.size() != snapshot.positions.size()) {
+        lastPublishedPositions = snapshot.positions;
+    }
+    snapshot.previousPositions.assign(lastPublishedPositions.begin(), lastPublishedPositions.end());
+    lastPublishedPositions.assign(snapshot.positions.begin(), snapshot.positions.end());
+
+    snapshot.boxTransform = scene->getBox()->getTransform();
+    snapshot.stepDt = solver->getStepDt();
+    snapshot.stepTime = stepTime;
+    snapshots.publish();
+}
@@ -6,14 +6,13 @@ Solver::Solver() : outFile("debug.txt"){
     substeps = 1;
     substep_dt = step_dt / substeps;
 
-    // Seed the random number generator
-    srand(static_cast<unsigned int>(time(0)));
-
     fluid_restitution = 0.5f;
     wall_restitution = 0.8f;
     threshold = 0.01f; 
     cell_size = 0.15f;
     numThreads = 4;
+    frameCount = 0;
+    layoutVersion = 0;
 }
 
 Solver::Solver(float particleSize, int i_numThreads) : outFile("debug.txt"){
@@ -22,21 +21,16 @@ Solver::Solver(float particleSize, int i_numThreads) : outFile("debug.txt"){
     substeps = 4;
     substep_dt = step_dt / substeps;
 
-    // Seed the random number generator
-    srand(static_cast<unsigned int>(time(0)));
-
     fluid_restitution = 1.0f;
     wall_restitution = 0.8f;
     threshold = 0.01f; 
     cell_size = 1.5f * particleSize; // Adjust cell size based on particle size
     numThreads = i_numThreads;
+    frameCount = 0;
+    layoutVersion = 0;
 }
 
-Solver::~Solver(){
-    for (int i = 0; i < particles.size(); i++) {
-        delete particles[i];
-    }
-}
+Solver::~Solver(){} // particleBlocks frees every particle
 
 void Solver::printSolverInfo(){
     //outFile << "-------- particles info ---------" << std::endl;
@@ -59,32 +53,110 @@ void Solver::printSolverInfo(){
  }
 
 void Solver::addParticle(glm::vec3 position, float radius, bool i_activated){
-    particles.push_back(new Particle(position, radius, i_activated));
+    particleBlocks.emplace_back(new Particle[1]);
+    particleBlocks.back()[0] = Particle(position, radius, i_activated);
+    particles.push_back(&particleBlocks.back()[0]);
+    layoutVersion++;
+
+    int particleID = particles.size() - 1;
+    particles[particleID]->setVelocity(getSpawnVelocity(particleID), substep_dt);
+}
+
+// Allocates all new particles as one block, then fills them in and draws their velocities in parallel
+// --> particles stays a vector of pointers - the solver and scene index it everywhere - but they all point into the block,
+//     so emitting a million particles is one heap allocation instead of a million contending ones
+// --> Safe to split across threads because the counter-based RNG has no shared state
+void Solver::addParticles(int count, const std::function<glm::vec3(int)>& positionAt, float radius, bool i_activated){
+    if (count <= 0) return;
+
+    Particle* block = new Particle[count];
+    particleBlocks.emplace_back(block);
+    int firstID = particles.size();
+    particles.resize(firstID + count, nullptr);
+    layoutVersion++;
+
+    int particlesPerThread = (count + numThreads - 1) / numThreads; // ceiling division
+    std::vector<std::thread> threads;
+    threads.reserve(numThreads);
+
+    for (int t = 0; t < numThreads; ++t) {
+        int start = t * particlesPerThread;
+        int end = std::min(start + particlesPerThread, count);
+        if (start >= end) break;
+        threads.emplace_back(&Solver::emitParticlesThread, this, block, firstID, start, end, std::cref(positionAt), radius, i_activated);
+    }
+
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+}
 
-    // Generate a float between a range
-    float min = 45.0f;
-    float max = 180.0f;
+void Solver::emitParticlesThread(Particle* block, int firstID, int startIdx, int endIdx, const std::function<glm::vec3(int)>& positionAt, float radius, bool i_activated){
+    for (int k = startIdx; k < endIdx; k++) {
+        int particleID = firstID + k;
+        block[k] = Particle(positionAt(k), radius, i_activated);
+        particles[particleID] = &block[k];
+        particles[particleID]->setVelocity(getSpawnVelocity(particleID), substep_dt);
+    }
+}
+
+void Solver::setSeed(uint64_t seed){
+    rng = CounterRNG(seed);
+}
 
+glm::vec3 Solver::getSpawnVelocity(int particleID){
     float speed = 7.0f;
 
+    // Frame 0: particles are spawned before the first update
+    float u[4];
+    rng.uniform4(static_cast<uint32_t>(particleID), 0, RNG_STREAM_SPAWN_VELOCITY, u);
+
     // Random angles for spherical coordinates
-    float theta = ((float)rand() / RAND_MAX) * 2.0f * M_PI; // azimuthal angle (around Y axis)
-    float phi = ((float)rand() / RAND_MAX) * (M_PI / 4.0f); 
+    float theta = u[0] * 2.0f * M_PI; // azimuthal angle (around Y axis)
+    float phi = u[1] * (M_PI / 4.0f); 
 
     // Convert spherical to Cartesian velocity
     float vx = speed * sin(phi) * cos(theta);
     float vy = -speed * cos(phi);    // downward
     float vz = speed * sin(phi) * sin(theta);
 
-    glm::vec3 initialVelocity = glm::vec3(vx, vy, vz);
-    particles[particles.size() - 1]->setVelocity(initialVelocity, substep_dt);
-
+    return glm::vec3(vx, vy, vz);
 }
 
-std::vector<Particle*> Solver::getParticles(){
+const std::vector<Particle*>& Solver::getParticles(){
     return particles;
 }
 
+void Solver::writeSnapshot(ParticleSnapshot& snapshot){
+    // Snapshot slots are reused, so this only allocates the first time a slot is filled
+    int n = particles.size();
+    snapshot.positions.resize(n);
+    snapshot.flags.resize(n);
+    for (int i = 0; i < n; i++) {
+        snapshot.positions[i] = particles[i]->getPosition();
+        snapshot.flags[i] = particles[i]->getActivated() ? PARTICLE_FLAG_ACTIVE : 0;
+    }
+
+    // Radii only change when particles are added
+    if (snapshot.layoutVersion != layoutVersion || snapshot.radii.size() != (size_t)n) {
+        snapshot.radii.resize(n);
+        for (int i = 0; i < n; i++) {
+            snapshot.radii[i] = particles[i]->getRadius();
+        }
+        snapshot.layoutVersion = layoutVersion;
+    }
+
+    snapshot.frame = frameCount;
+}
+
+float Solver::getStepDt(){
+    return step_dt;
+}
+
+uint64_t Solver::getFrameCount(){
+    return frameCount;
+}
+
 void Solver::activateNewParticle(int index){
     particles[index]->activateParticle();
 }
@@ -240,6 +312,8 @@ void Solver::update(Container* gBox, int counter){
 
         auto t5 = std::chrono::high_resolution_clock::now();
     }
+
+    frameCount++;
 }
 
 void Solver::applyGravity(){
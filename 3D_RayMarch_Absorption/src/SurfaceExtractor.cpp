@@ -0,0 +1,264 @@
+#include "SurfaceExtractor.hpp"
+
+// Marching cubes cases, derived once from the cell's geometry instead of written out as the usual 256-entry table
+// --> Corner c of a cell sits at (c & 1, (c >> 1) & 1, (c >> 2) & 1); a corner is inside when its distance is negative
+// --> On each face the surface runs from every edge where the walk around the face (counter-clockwise seen from
+//     outside the cell) enters the inside to the next edge where it leaves; on faces with two diagonal inside
+//     corners this keeps the corners apart - decided by the face alone, so neighbouring cells always agree
+// --> Every crossed edge ends one face's segment and starts the other's, so the segments close into loops, which
+//     are fanned into triangles facing out of the fluid
+struct CubeCases{
+    int edgeCorner[12]; // lower corner of each edge
+    int edgeAxis[12]; // edge runs from edgeCorner along this axis
+    std::vector<glm::ivec3> triangles[256]; // per inside-corner mask, three edges per triangle
+};
+
+static CubeCases BuildCubeCases(){
+    CubeCases cases;
+
+    int edgeOf[8][3]; // [lower corner][axis] -> edge
+    int numEdges = 0;
+    for (int axis = 0; axis < 3; axis++) {
+        for (int corner = 0; corner < 8; corner++) {
+            if ((corner >> axis) & 1) continue;
+            cases.edgeCorner[numEdges] = corner;
+            cases.edgeAxis[numEdges] = axis;
+            edgeOf[corner][axis] = numEdges++;
+        }
+    }
+    auto edgeBetween = [&](int a, int b) {
+        int axis = (a ^ b) == 1 ? 0 : ((a ^ b) == 2 ? 1 : 2);
+        return edgeOf[std::min(a, b)][axis];
+    };
+
+    for (int mask = 0; mask < 256; mask++) {
+        int next[12];
+        std::fill(next, next + 12, -1);
+
+        for (int axis = 0; axis < 3; axis++) {
+            for (int side = 0; side < 2; side++) {
+                // (u, v, axis) is right-handed, so this order is counter-clockwise seen from +axis
+                int u = (axis + 1) % 3;
+                int v = (axis + 2) % 3;
+                const int faceU[4] = {0, 1, 1, 0};
+                const int faceV[4] = {0, 0, 1, 1};
+                int corners[4];
+                for (int i = 0; i < 4; i++) {
+                    int j = side == 1 ? i : 3 - i; // the -axis face is seen from the other side
+                    corners[i] = (side << axis) | (faceU[j] << u) | (faceV[j] << v);
+                }
+
+                bool inside[4];
+                for (int i = 0; i < 4; i++) inside[i] = (mask >> corners[i]) & 1;
+                for (int i = 0; i < 4; i++) {
+                    if (inside[i] || !inside[(i + 1) % 4]) continue;
+                    for (int k = 1; k < 4; k++) {
+                        int j = (i + k) % 4;
+                        if (inside[j] && !inside[(j + 1) % 4]) {
+                            next[edgeBetween(corners[i], corners[(i + 1) % 4])] = edgeBetween(corners[j], corners[(j + 1) % 4]);
+                            break;
+                        }
+                    }
+                }
+            }
+        }
+
+        bool visited[12] = {};
+        for (int start = 0; start < 12; start++) {
+            if (next[start] < 0 || visited[start]) continue;
+            std::vector<int> loop;
+            for (int edge = start; !visited[edge]; edge = next[edge]) {
+                visited[edge] = true;
+                loop.push_back(edge);
+            }
+            for (size_t i = 1; i + 1 < loop.size(); i++) {
+                cases.triangles[mask].push_back(glm::ivec3(loop[0], loop[i], loop[i + 1]));
+            }
+        }
+    }
+    return cases;
+}
+
+static const CubeCases& GetCubeCases(){
+    static const CubeCases cases = BuildCubeCases();
+    return cases;
+}
+
+SurfaceExtractor::SurfaceExtractor(){
+    numThreads = std::max(1u, std::thread::hardware_concurrency());
+    blockCounts = glm::ivec3(0);
+    nextBlock = 0;
+    occupiedBlocks = 0;
+}
+
+void SurfaceExtractor::setResolution(int resolution){
+    particleVolume.setResolution(resolution);
+}
+
+void SurfaceExtractor::Extract(ParticleSpan<glm::vec3> i_positions, ParticleSpan<float> radii, ParticleSpan<uint8_t> flags, float blendFactor){
+    positions.clear();
+    normals.clear();
+    indices.clear();
+    occupiedBlocks = 0;
+
+    particleGrid.Build(i_positions, radii, flags, blendFactor);
+    if (particleGrid.getParticleCount() == 0) return;
+    particleVolume.Build(particleGrid);
+
+    glm::ivec3 cellCounts = particleVolume.getDims() - 1;
+    blockCounts = (cellCounts + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    blockMeshes.resize(blockCounts.x * blockCounts.y * blockCounts.z);
+
+    // Blocks are taken one at a time, so threads that draw empty blocks simply take more of them
+    nextBlock = 0;
+    std::vector<std::thread> threads;
+    for (int t = 0; t < numThreads; ++t) {
+        threads.emplace_back(&SurfaceExtractor::ExtractBlocksThread, this);
+    }
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+
+    // Concatenate the blocks, shifting each block's indices past the vertices of the blocks before it
+    size_t numVertices = 0;
+    size_t numIndices = 0;
+    for (const BlockMesh& mesh : blockMeshes) {
+        numVertices += mesh.positions.size();
+        numIndices += mesh.indices.size();
+    }
+    positions.reserve(numVertices);
+    normals.reserve(numVertices);
+    indices.reserve(numIndices);
+    for (const BlockMesh& mesh : blockMeshes) {
+        uint32_t offset = positions.size();
+        positions.insert(positions.end(), mesh.positions.begin(), mesh.positions.end());
+        normals.insert(normals.end(), mesh.normals.begin(), mesh.normals.end());
+        for (uint32_t index : mesh.indices) {
+            indices.push_back(offset + index);
+        }
+    }
+}
+
+void SurfaceExtractor::ExtractBlocksThread(){
+    int numBlocks = blockMeshes.size();
+    for (int block = nextBlock++; block < numBlocks; block = nextBlock++) {
+        ExtractBlock(block);
+    }
+}
+
+void SurfaceExtractor::ExtractBlock(int blockIndex){
+    BlockMesh& mesh = blockMeshes[blockIndex];
+    mesh.positions.clear();
+    mesh.normals.clear();
+    mesh.indices.clear();
+    mesh.edgeVertices.clear();
+
+    glm::ivec3 dims = particleVolume.getDims();
+    const std::vector<glm::vec2>& voxels = particleVolume.getVoxels();
+    glm::ivec3 block = glm::ivec3(blockIndex % blockCounts.x, (blockIndex / blockCounts.x) % blockCounts.y, blockIndex / (blockCounts.x * blockCounts.y));
+    glm::ivec3 cellMin = block * BLOCK_SIZE;
+    glm::ivec3 cellMax = glm::min(cellMin + BLOCK_SIZE, dims - 1); // exclusive
+
+    // Only blocks with voxels on both sides of the surface hold any of it - outside the band everything is empty space
+    bool anyInside = false;
+    bool anyOutside = false;
+    for (int z = cellMin.z; z <= cellMax.z && !(anyInside && anyOutside); z++) {
+        for (int y = cellMin.y; y <= cellMax.y; y++) {
+            const glm::vec2* row = &voxels[((size_t)z * dims.y + y) * dims.x];
+            for (int x = cellMin.x; x <= cellMax.x; x++) {
+                if (row[x].x < 0.0f) anyInside = true;
+                else anyOutside = true;
+            }
+        }
+    }
+    if (!anyInside || !anyOutside) return;
+    occupiedBlocks++;
+
+    const CubeCases& cases = GetCubeCases();
+    for (int z = cellMin.z; z < cellMax.z; z++) {
+        for (int y = cellMin.y; y < cellMax.y; y++) {
+            for (int x = cellMin.x; x < cellMax.x; x++) {
+                int mask = 0;
+                for (int corner = 0; corner < 8; corner++) {
+                    int cx = x + (corner & 1);
+                    int cy = y + ((corner >> 1) & 1);
+                    int cz = z + ((corner >> 2) & 1);
+                    if (voxels[((size_t)cz * dims.y + cy) * dims.x + cx].x < 0.0f) mask |= 1 << corner;
+                }
+
+                for (const glm::ivec3& triangle : cases.triangles[mask]) {
+                    for (int k = 0; k < 3; k++) {
+                        int edge = triangle[k];
+                        int corner = cases.edgeCorner[edge];
+                        glm::ivec3 voxel(x + (corner & 1), y + ((corner >> 1) & 1), z + ((corner >> 2) & 1));
+                        mesh.indices.push_back(EdgeVertex(mesh, voxel, cases.edgeAxis[edge]));
+                    }
+                }
+            }
+        }
+    }
+}
+
+uint32_t SurfaceExtractor::EdgeVertex(BlockMesh& mesh, const glm::ivec3& voxel, int axis){
+    glm::ivec3 dims = particleVolume.getDims();
+    size_t voxelIndex = ((size_t)voxel.z * dims.y + voxel.y) * dims.x + voxel.x;
+    uint64_t key = (uint64_t)voxelIndex * 3 + axis;
+    auto found = mesh.edgeVertices.find(key);
+    if (found != mesh.edgeVertices.end()) return found->second;
+
+    // Where the distance crosses zero between the edge's two voxels
+    glm::ivec3 step(0);
+    step[axis] = 1;
+    const std::vector<glm::vec2>& voxels = particleVolume.getVoxels();
+    float d0 = voxels[voxelIndex].x;
+    float d1 = voxels[((size_t)(voxel.z + step.z) * dims.y + voxel.y + step.y) * dims.x + voxel.x + step.x].x;
+    float t = d0 / (d0 - d1);
+
+    glm::vec3 position = particleVolume.getOrigin() + (glm::vec3(voxel) + t * glm::vec3(step)) * particleVolume.getVoxelSize();
+    glm::vec3 gradient = glm::mix(Gradient(voxel), Gradient(voxel + step), t);
+    float gradientLength = glm::length(gradient);
+
+    uint32_t vertex = mesh.positions.size();
+    mesh.positions.push_back(position);
+    mesh.normals.push_back(gradientLength > 0.0f ? gradient / gradientLength : glm::vec3(0.0f, 1.0f, 0.0f));
+    mesh.edgeVertices.emplace(key, vertex);
+    return vertex;
+}
+
+glm::vec3 SurfaceExtractor::Gradient(const glm::ivec3& voxel){
+    glm::ivec3 dims = particleVolume.getDims();
+    const std::vector<glm::vec2>& voxels = particleVolume.getVoxels();
+    auto distance = [&](glm::ivec3 v) {
+        v = glm::clamp(v, glm::ivec3(0), dims - 1);
+        return voxels[((size_t)v.z * dims.y + v.y) * dims.x + v.x].x;
+    };
+
+    glm::vec3 gradient;
+    for (int axis = 0; axis < 3; axis++) {
+        glm::ivec3 step(0);
+        step[axis] = 1;
+        gradient[axis] = distance(voxel + step) - distance(voxel - step);
+    }
+    return gradient;
+}
+
+const std::vector<glm::vec3>& SurfaceExtractor::getPositions(){
+    return positions;
+}
+
+const std::vector<glm::vec3>& SurfaceExtractor::getNormals(){
+    return normals;
+}
+
+const std::vector<uint32_t>& SurfaceExtractor::getIndices(){
+    return indices;
+}
+
+int SurfaceExtractor::getOccupiedBlockCount(){
+    return occupiedBlocks;
+}
+
+bool SurfaceExtractor::SaveMesh(const std::string& path){
+    bool obj = path.size() >= 4 && path.compare(path.size() - 4, 4, ".obj") == 0;
+    return obj ? WriteOBJ(path, positions, normals, indices) : WritePLY(path, positions, normals, indices);
+}
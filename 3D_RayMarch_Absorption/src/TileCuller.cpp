@@ -0,0 +1,121 @@
+#include "TileCuller.hpp"
+
+TileCuller::TileCuller(){
+    numThreads = std::max(1u, std::thread::hardware_concurrency());
+    particles = nullptr;
+    view = glm::mat4(1.0f);
+    projectionX = 1.0f;
+    projectionY = 1.0f;
+    nearPlane = 0.1f;
+    inflation = 0.0f;
+    screenSize = glm::vec2(1.0f);
+    tileCounts = glm::ivec2(1);
+    tileStarts.assign(2, 0);
+}
+
+void TileCuller::Build(const std::vector<glm::vec4>& i_particles, const glm::mat4& i_view, const glm::mat4& projection,
+                       int width, int height, float i_inflation){
+    particles = &i_particles;
+    view = i_view;
+    projectionX = projection[0][0];
+    projectionY = projection[1][1];
+    nearPlane = projection[3][2] / (projection[2][2] - 1.0f); // glm::perspective: [2][2] = -(f+n)/(f-n), [3][2] = -2fn/(f-n)
+    inflation = i_inflation;
+    screenSize = glm::vec2(width, height);
+    tileCounts = glm::ivec2((width + TILE_SIZE - 1) / TILE_SIZE, (height + TILE_SIZE - 1) / TILE_SIZE); // ceiling division
+
+    // (1) Screen rectangle of every particle, in parallel
+    int n = i_particles.size();
+    tileRects.resize(n);
+    int particlesPerThread = (n + numThreads - 1) / numThreads; // ceiling division
+    std::vector<std::thread> threads;
+    for (int t = 0; t < numThreads; ++t) {
+        int start = t * particlesPerThread;
+        int end = std::min(start + particlesPerThread, n);
+        if (start >= end) break;
+        threads.emplace_back(&TileCuller::ComputeRectsThread, this, start, end);
+    }
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+
+    // (2) Count per tile, then scatter - particles keep their order within a tile, so the blend order is stable
+    int numTiles = tileCounts.x * tileCounts.y;
+    tileStarts.assign(numTiles + 1, 0);
+    for (const glm::ivec4& rect : tileRects) {
+        for (int y = rect.y; y <= rect.w; y++) {
+            for (int x = rect.x; x <= rect.z; x++) {
+                tileStarts[y * tileCounts.x + x + 1]++;
+            }
+        }
+    }
+    for (int t = 0; t < numTiles; t++) {
+        tileStarts[t + 1] += tileStarts[t];
+    }
+    tileCursor.assign(tileStarts.begin(), tileStarts.end() - 1);
+    tileParticles.resize(tileStarts[numTiles]);
+    for (int i = 0; i < n; i++) {
+        const glm::ivec4& rect = tileRects[i];
+        for (int y = rect.y; y <= rect.w; y++) {
+            for (int x = rect.x; x <= rect.z; x++) {
+                tileParticles[tileCursor[y * tileCounts.x + x]++] = i;
+            }
+        }
+    }
+
+    particles = nullptr;
+}
+
+void TileCuller::ComputeRectsThread(int startIdx, int endIdx){
+    const glm::ivec4 empty(0, 0, -1, -1);
+    const glm::ivec4 fullScreen(0, 0, tileCounts.x - 1, tileCounts.y - 1);
+
+    for (int i = startIdx; i < endIdx; i++) {
+        const glm::vec4& particle = (*particles)[i];
+        glm::vec3 center = glm::vec3(view * glm::vec4(glm::vec3(particle), 1.0f));
+        float radius = particle.w + inflation;
+        float depth = -center.z; // distance in front of the camera
+
+        if (depth + radius <= nearPlane) {
+            tileRects[i] = empty; // entirely behind the camera
+            continue;
+        }
+        if (depth - radius <= nearPlane) {
+            tileRects[i] = fullScreen; // crosses the near plane - no finite projection
+            continue;
+        }
+
+        // Conservative bounds: each edge divides by whichever sphere depth makes it reach furthest out
+        glm::vec2 maxEdge = glm::vec2(center) + radius;
+        glm::vec2 minEdge = glm::vec2(center) - radius;
+        glm::vec2 ndcMax, ndcMin;
+        ndcMax.x = projectionX * maxEdge.x / (maxEdge.x >= 0.0f ? depth - radius : depth + radius);
+        ndcMax.y = projectionY * maxEdge.y / (maxEdge.y >= 0.0f ? depth - radius : depth + radius);
+        ndcMin.x = projectionX * minEdge.x / (minEdge.x >= 0.0f ? depth + radius : depth - radius);
+        ndcMin.y = projectionY * minEdge.y / (minEdge.y >= 0.0f ? depth + radius : depth - radius);
+
+        if (ndcMax.x < -1.0f || ndcMax.y < -1.0f || ndcMin.x > 1.0f || ndcMin.y > 1.0f) {
+            tileRects[i] = empty; // off screen
+            continue;
+        }
+
+        // NDC [-1, 1] -> pixels -> tiles, counted from the bottom left like gl_FragCoord
+        glm::ivec2 first = glm::ivec2(glm::floor((ndcMin * 0.5f + 0.5f) * screenSize / (float)TILE_SIZE));
+        glm::ivec2 last = glm::ivec2(glm::floor((ndcMax * 0.5f + 0.5f) * screenSize / (float)TILE_SIZE));
+        first = glm::clamp(first, glm::ivec2(0), tileCounts - 1);
+        last = glm::clamp(last, glm::ivec2(0), tileCounts - 1);
+        tileRects[i] = glm::ivec4(first, last);
+    }
+}
+
+const std::vector<int>& TileCuller::getTileStarts(){
+    return tileStarts;
+}
+
+const std::vector<int>& TileCuller::getTileParticles(){
+    return tileParticles;
+}
+
+glm::ivec2 TileCuller::getTileCounts(){
+    return tileCounts;
+}
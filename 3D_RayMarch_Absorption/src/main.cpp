@@ -1,5 +1,5 @@
 /* Compilation on Linux: 
- g++ -std=c++17 ./src/*.cpp -o prog -I ./include/ -I./../common/thirdparty/ -lSDL2 -ldl
+ g++ -std=c++17 ./src/*.cpp -o prog -I ./include/ -I./../common/thirdparty/ -lSDL2 -lEGL -ldl
 */
 
 // Third Party Libraries
@@ -19,6 +19,9 @@
 #include <unordered_map>
 #include <chrono>
 #include <thread>
+#include <cstdlib>
+#include <cerrno>
+#include <climits>
 
 // Our libraries
 #include "Camera.hpp"
@@ -29,6 +32,11 @@
 #include "Renderer.hpp"
 #include "Scene.hpp"
 #include "ModelProcessor.hpp"
+#include "SimulationThread.hpp"
+#include "HeadlessContext.hpp"
+#include "CpuRayMarcher.hpp"
+#include "CpuSplatRenderer.hpp"
+#include "SurfaceExtractor.hpp"
 
 // vvvvvvvvvvvvvvvvvvvvvvvvvv Globals vvvvvvvvvvvvvvvvvvvvvvvvvv
 // Globals generally are prefixed with 'g' in this application.
@@ -51,6 +59,53 @@ float gParticleSize = 0.2f;
 bool gPause = false;
 int gCounter = 0;
 
+// true: ray-marched rendered preview, false: Phong simulation preview
+bool gRayMarchPreview = true;
+// Phong preview particles: true = ray-cast sphere impostors, false = the tessellated sphere mesh
+bool gImpostorPreview = true;
+// Phong preview: draw the fluid surface extracted by marching cubes instead of the particles
+bool gSurfaceMeshPreview = false;
+// Ray-march volume voxels along the longest axis of the fluid - higher is sharper but slower to bake
+// --> 0 = evaluate particles per pixel: analytic normals, tile culling and particle motion for reprojection, and the
+//     path CpuRayMarcher matches; frames whose particle lists exceed the GPU's texture buffers use a 64 voxel volume
+int gVolumeResolution = 0;
+// Ray-march resolution scale while the view is changing (0.5 = a quarter of the pixels); full resolution once it is still
+float gRayMarchScaleMoving = 0.5f;
+bool gViewMoving = false; // set by Input() when the camera or the box moved this frame
+// Ray-march a quarter of the pixels each frame and reproject the rest from the previous frame
+bool gTemporalRayMarch = false;
+// Rendered preview as screen-space fluid (smoothed sphere depths + splatted thickness) instead of SDF ray marching
+// --> Costs per pixel rather than per particle x march step - the mode for scenes beyond ~100k particles
+bool gScreenSpaceFluid = false;
+// Ray-march shading: dim the light by the fluid between each surface point and the light (deep shadow grid)
+// --> Only with gVolumeResolution > 0, since the grid is marched through the baked volume; it adds a CPU light march
+//     per frame (~2.5 ms at 125 particles, ~6.5 ms at 8000 on one core)
+bool gLightShadows = false;
+// Ray-march step counts - keys 1/2/3 switch between low, medium and high at runtime (every level is linked at startup)
+RayMarchQuality gRayMarchQuality = RAY_MARCH_QUALITY_HIGH;
+
+// Frame pacing: vsync if the driver allows it, otherwise gTargetFPS (0 = uncapped)
+bool gVsync = true;
+int gTargetFPS = 60;
+float gFrameDt = 1.0f / 60.0f; // wall-clock duration of the last rendered frame in seconds
+
+// Batch rendering without a window: ./prog --headless [frames] [output prefix] [--cpu | --splat | --screen-space | --mesh [--obj]] [--incremental]
+//                                                  [--quality=low|medium|high]
+// writes <prefix>_0000.ppm, <prefix>_0001.ppm, ...
+// --> default: the GL Renderer through EGL, --cpu: CpuRayMarcher, --splat: CpuSplatRenderer (neither needs a GPU or GL driver)
+// --> --screen-space: the GL Renderer with gScreenSpaceFluid
+// --> --mesh: no images - the SurfaceExtractor mesh of every frame as <prefix>_0000.ply, ... (.obj with --obj)
+// --> Unknown flags, a frame count that is not a positive number, or a third positional argument print the usage and fail
+const char* gHeadlessUsage =
+	"Usage: ./prog --headless [frames] [output prefix] [--cpu | --splat | --screen-space | --mesh [--obj]] [--incremental]\n"
+	"                         [--quality=low|medium|high]\n";
+enum HeadlessBackend { HEADLESS_GL, HEADLESS_CPU_RAY_MARCH, HEADLESS_CPU_SPLAT, HEADLESS_CPU_MESH };
+int gHeadlessFrames = 120;
+std::string gHeadlessOutput = "frame";
+HeadlessBackend gHeadlessBackend = HEADLESS_GL;
+bool gHeadlessIncremental = false; // --incremental (with --cpu): only re-march the screen tiles whose particles moved
+std::string gHeadlessMeshExtension = ".ply";
+
 bool  g_rotatePositive=true;
 float g_uRotate=0.0f;
 
@@ -60,6 +115,13 @@ Camera gCamera;
 ModelProcessor gModelProcessor;
 Scene gScene(&gSolver, &gCamera, &gModelProcessor);
 Renderer gRenderer(gScreenWidth, gScreenHeight, &gScene);
+SimulationThread gSimulationThread(&gSolver, &gScene);
+CpuRayMarcher gCpuRayMarcher;
+CpuSplatRenderer gCpuSplatRenderer;
+SurfaceExtractor gSurfaceExtractor;
+#ifdef LINUX
+HeadlessContext gHeadlessContext;
+#endif
 
 // Variables that will need adjusting based on each other: 
 //		gParticleSize (remember to adjust the particle radius in fragRayMarch.glsl)
@@ -68,7 +130,7 @@ Renderer gRenderer(gScreenWidth, gScreenHeight, &gScene);
 //		wall_r (in Solver)
 //		thresholdContainer (in Solver)
 //      cell_size (in Solver) - generally 1.5 * gParticleSize
-//      Blend_factor (in fragRayMarch.glsl)
+//      Blend_factor (Renderer::blendFactor, compiled into fragRayMarch.glsl)
 
 // Good variables
 // size = 0.2f, damping = 0.7f, fluid_r = 1.0f, wall_r = 0.8f, thresholdContainer = 1.05f, blend_factor = 0.3f
@@ -222,6 +284,13 @@ void Input(){
 				std::cout << "Space key pressed!" << std::endl;
 				// Do something when space is pressed
 				break;
+			case SDLK_1:
+			case SDLK_2:
+			case SDLK_3:
+				gRayMarchQuality = (RayMarchQuality)(RAY_MARCH_QUALITY_LOW + (e.key.keysym.sym - SDLK_1));
+				gRenderer.setRayMarchQuality(gRayMarchQuality);
+				std::cout << "Ray-march quality " << gRayMarchQuality + 1 << "/" << RAY_MARCH_QUALITY_COUNT << std::endl;
+				break;
         }
     }
 	}
@@ -229,37 +298,46 @@ void Input(){
     // Retrieve keyboard state
     const Uint8 *state = SDL_GetKeyboardState(NULL);
 
+    gViewMoving = state[SDL_SCANCODE_W] || state[SDL_SCANCODE_S] || state[SDL_SCANCODE_A] || state[SDL_SCANCODE_D] ||
+                  state[SDL_SCANCODE_LEFT] || state[SDL_SCANCODE_RIGHT];
+
     // Camera
     // Update our position of the camera
+    // Camera speed is per second, so it does not depend on the frame rate
+    float cameraSpeed = 6.0f * gFrameDt;
     if (state[SDL_SCANCODE_W]) {
-        gCamera.MoveForward(0.1f);
+        gCamera.MoveForward(cameraSpeed);
     }
     if (state[SDL_SCANCODE_S]) {
-        gCamera.MoveBackward(0.1f);
+        gCamera.MoveBackward(cameraSpeed);
     }
     if (state[SDL_SCANCODE_A]) {
-        gCamera.MoveLeft(0.1f);
+        gCamera.MoveLeft(cameraSpeed);
     }
     if (state[SDL_SCANCODE_D]) {
-        gCamera.MoveRight(0.1f);
+        gCamera.MoveRight(cameraSpeed);
     }
+	float boxRotationSpeed = 120.0f * gFrameDt; // degrees per second
 	if (state[SDL_SCANCODE_LEFT]) {
-        gRenderer.updateZ(2.0f);
-		gScene.updateBoxRotationZ(2.0f);
+        gRenderer.updateZ(boxRotationSpeed);
+		gSimulationThread.requestBoxRotationZ(boxRotationSpeed);
     }
     if (state[SDL_SCANCODE_RIGHT]) {
-        gRenderer.updateZ(-2.0f);
-		gScene.updateBoxRotationZ(-2.0f);
+        gRenderer.updateZ(-boxRotationSpeed);
+		gSimulationThread.requestBoxRotationZ(-boxRotationSpeed);
     }
 }
 
 void CleanUp(){
+	// The solver must be idle before its particles and the scene go away
+	gSimulationThread.stop();
+
 	//Destroy our SDL2 Window
 	SDL_DestroyWindow(gGraphicsApplicationWindow );
 	gGraphicsApplicationWindow = nullptr;
 
     // Delete our OpenGL Objects
-    gModelProcessor.CleanUp(gSolver.getParticles().size());
+    gModelProcessor.CleanUp();
 
 	// Delete our Graphics pipeline
     gRenderer.CleanUp();
@@ -278,17 +356,175 @@ void updateFPS() {
         fps = frameCount / elapsed.count();
         frameCount = 0;
         lastTime = currentTime;
+
+        // Report once per second rather than every frame
+        std::cout << "FPS: " << fps << std::endl;
     }
 }
 
+// Renders gHeadlessFrames frames without a window and writes each one to disk
+// --> The solver is stepped here rather than on the simulation thread: one solver frame per image (60 images per simulated second),
+//     so the sequence is the same however long each frame takes to render (e.g. on llvmpipe without a GPU)
+// --> The CPU backends never create a GL context
+int RunHeadless(){
+	if (gHeadlessBackend == HEADLESS_CPU_RAY_MARCH) {
+		gScene.SetupSceneWithCuboidSetup(5, 5, 5, gParticleSize, false);
+		gCpuRayMarcher.setResolution(gScreenWidth, gScreenHeight);
+		gCpuRayMarcher.setIncremental(gHeadlessIncremental);
+	}
+	else if (gHeadlessBackend == HEADLESS_CPU_SPLAT) {
+		gScene.SetupSceneWithCuboidSetup(5, 5, 5, gParticleSize, false);
+		gCpuSplatRenderer.setResolution(gScreenWidth, gScreenHeight);
+	}
+	else if (gHeadlessBackend == HEADLESS_CPU_MESH) {
+		gScene.SetupSceneWithCuboidSetup(5, 5, 5, gParticleSize, false);
+		gSurfaceExtractor.setResolution(gVolumeResolution > 0 ? gVolumeResolution : 64);
+	}
+	else {
+#ifdef LINUX
+		gHeadlessContext.Initialize(gScreenWidth, gScreenHeight);
+		getOpenGLVersionInfo();
+
+		gScene.SetupSceneWithCuboidSetup(5, 5, 5, gParticleSize);
+
+		gRenderer.CreateGraphicsPipelines();
+		gRenderer.setVolumeResolution(gVolumeResolution);
+		gRenderer.setTemporalMode(gTemporalRayMarch);
+		gRenderer.setImpostorMode(gImpostorPreview);
+		gRenderer.setSurfaceMeshMode(gSurfaceMeshPreview);
+		gRenderer.setLightShadows(gLightShadows);
+		gRenderer.setRayMarchQuality(gRayMarchQuality);
+		gRenderer.VertexSpecification();
+#else
+		std::cout << "Headless GL rendering needs EGL and is only available on Linux - use --cpu or --splat\n";
+		return 1;
+#endif
+	}
+
+	const int activationInterval = 15; // solver frames between released particles (250 ms, as in the windowed loop)
+	ParticleSnapshot snapshot;
+	for (int frame = 0; frame < gHeadlessFrames; frame++) {
+		auto frameStart = std::chrono::high_resolution_clock::now();
+
+		if (!gScene.getIfCuboidSolverSetup() && gParticleIndexToActivate < gNumParticles && frame % activationInterval == 0) {
+			gSolver.activateNewParticle(gParticleIndexToActivate);
+			gParticleIndexToActivate++;
+		}
+		gSolver.update(gScene.getBox(), gSolver.getFrameCount());
+		gSolver.writeSnapshot(snapshot);
+		snapshot.boxTransform = gScene.getBox()->getTransform();
+
+		char frameNumber[16];
+		snprintf(frameNumber, sizeof(frameNumber), "_%04d.ppm", frame);
+		std::string path = gHeadlessOutput + frameNumber;
+
+		if (gHeadlessBackend == HEADLESS_CPU_RAY_MARCH) {
+			gCpuRayMarcher.Render(snapshot.getPositions(), snapshot.getRadii(), snapshot.getFlags(),
+								  gCamera.GetViewMatrix(), gCamera.GetCameraEyePosition(), gScene.getLights()[0]->getPosition());
+			gCpuRayMarcher.SaveFrame(path);
+		}
+		else if (gHeadlessBackend == HEADLESS_CPU_SPLAT) {
+			gCpuSplatRenderer.Render(snapshot.getPositions(), snapshot.getRadii(), snapshot.getFlags(),
+									 gCamera.GetViewMatrix(), gScene.getLights()[0]->getPosition());
+			gCpuSplatRenderer.SaveFrame(path);
+		}
+		else if (gHeadlessBackend == HEADLESS_CPU_MESH) {
+			gSurfaceExtractor.Extract(snapshot.getPositions(), snapshot.getRadii(), snapshot.getFlags(), 0.5f); // Renderer's blend factor
+			gSurfaceExtractor.SaveMesh(path.substr(0, path.size() - 4) + gHeadlessMeshExtension);
+		}
+		else {
+#ifdef LINUX
+			gRenderer.setSnapshot(&snapshot, 1.0f);
+			gHeadlessContext.Bind();
+			if (gRayMarchPreview && gScreenSpaceFluid) {
+				gRenderer.RenderScene_ScreenSpaceFluid();
+			}
+			else if (gRayMarchPreview) {
+				gRenderer.RenderScene_RayMarch();
+			}
+			else {
+				gRenderer.RenderScene();
+			}
+			gHeadlessContext.SaveFrame(path);
+#endif
+		}
+
+		auto frameEnd = std::chrono::high_resolution_clock::now();
+		std::cout << "Frame " << frame + 1 << "/" << gHeadlessFrames << ": "
+				  << std::chrono::duration<double, std::milli>(frameEnd - frameStart).count() << " ms";
+		if (gHeadlessBackend == HEADLESS_CPU_RAY_MARCH) {
+			std::cout << " (" << gCpuRayMarcher.getMarchedTileCount() << " tiles marched)";
+		}
+		if (gHeadlessBackend == HEADLESS_CPU_MESH) {
+			std::cout << " (" << gSurfaceExtractor.getIndices().size() / 3 << " triangles, "
+					  << gSurfaceExtractor.getOccupiedBlockCount() << " blocks)";
+		}
+		std::cout << "\n";
+	}
+
+	if (gHeadlessBackend == HEADLESS_GL) {
+#ifdef LINUX
+		gModelProcessor.CleanUp();
+		gRenderer.CleanUp();
+		gHeadlessContext.CleanUp();
+#endif
+	}
+	return 0;
+}
+
 /**
 * The entry point into our C++ programs.
 *
 * @return program status
 */
 int main( int argc, char* args[] ){
+	if (argc > 1 && std::string(args[1]) == "--headless") {
+		int position = 0;
+		for (int i = 2; i < argc; i++) {
+			std::string arg = args[i];
+			if (arg == "--cpu") gHeadlessBackend = HEADLESS_CPU_RAY_MARCH;
+			else if (arg == "--splat") gHeadlessBackend = HEADLESS_CPU_SPLAT;
+			else if (arg == "--mesh") gHeadlessBackend = HEADLESS_CPU_MESH;
+			else if (arg == "--obj") gHeadlessMeshExtension = ".obj";
+			else if (arg == "--screen-space") gScreenSpaceFluid = true;
+			else if (arg == "--incremental") gHeadlessIncremental = true;
+			else if (arg == "--quality=low") gRayMarchQuality = RAY_MARCH_QUALITY_LOW;
+			else if (arg == "--quality=medium") gRayMarchQuality = RAY_MARCH_QUALITY_MEDIUM;
+			else if (arg == "--quality=high") gRayMarchQuality = RAY_MARCH_QUALITY_HIGH;
+			else if (arg.compare(0, 2, "--") == 0) {
+				std::cout << "Unknown option " << arg << "\n" << gHeadlessUsage;
+				return 1;
+			}
+			else if (position == 0) {
+				// Checked conversion - "12abc", "0" or a number past int range are all rejected
+				char* end = nullptr;
+				errno = 0;
+				long frames = std::strtol(arg.c_str(), &end, 10);
+				if (arg.empty() || *end != '\0' || errno == ERANGE || frames <= 0 || frames > INT_MAX) {
+					std::cout << "Frame count must be a positive number, got " << arg << "\n" << gHeadlessUsage;
+					return 1;
+				}
+				gHeadlessFrames = (int)frames;
+				position++;
+			}
+			else if (position == 1) {
+				gHeadlessOutput = arg;
+				position++;
+			}
+			else {
+				std::cout << "Unexpected argument " << arg << "\n" << gHeadlessUsage;
+				return 1;
+			}
+		}
+		return RunHeadless();
+	}
+
     std::cout << "Press ESC to quit\n";
 
+	// Startup timing, reported once the first frame is on screen
+	auto startupTime = std::chrono::high_resolution_clock::now();
+	bool firstFrameShown = false;
+
 	// Clock setup so particles can be steadily released
 	using clock = std::chrono::steady_clock;
 	auto lastActionTime = clock::now();
@@ -297,20 +533,43 @@ int main( int argc, char* args[] ){
 	// Setup the graphics program
 	InitializeProgram();
 
+	// Prefer vsync for pacing - fall back to the target frame rate if the driver refuses it
+	if (!gVsync || SDL_GL_SetSwapInterval(1) != 0) {
+		SDL_GL_SetSwapInterval(0);
+		gVsync = false;
+	}
+	auto frameDuration = std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(gTargetFPS > 0 ? 1.0 / gTargetFPS : 0.0));
+	auto nextFrameTime = clock::now();
+	auto lastFrameTime = clock::now();
+
+	auto setupStart = std::chrono::high_resolution_clock::now();
 	//gScene.SetupSceneWithCuboidSetup(10, 10, 10, gParticleSize);
 	//gScene.SetupSceneWithCuboidSetup(5, 5, 80, gParticleSize);
 	gScene.SetupSceneWithCuboidSetup(5, 5, 5, gParticleSize);
     //gScene.SetupScene(gNumParticles, gParticleSize);
+	auto setupEnd = std::chrono::high_resolution_clock::now();
+	std::cout << "Scene setup (" << gSolver.getParticles().size() << " particles): "
+			  << std::chrono::duration<double, std::milli>(setupEnd - setupStart).count() << " ms\n";
 
     gRenderer.CreateGraphicsPipelines();
 
+	gRenderer.setVolumeResolution(gVolumeResolution);
+	gRenderer.setTemporalMode(gTemporalRayMarch);
+	gRenderer.setImpostorMode(gImpostorPreview);
+	gRenderer.setSurfaceMeshMode(gSurfaceMeshPreview);
+	gRenderer.setLightShadows(gLightShadows);
+	gRenderer.setRayMarchQuality(gRayMarchQuality);
 	gRenderer.VertexSpecification();
+
+	// The solver runs on its own thread from here on - the main loop only reads its snapshots
+	gSimulationThread.start();
 	
 	// While application is running
 	while(!gQuit){
 		
 		auto now = clock::now();
-		auto t0 = std::chrono::high_resolution_clock::now();
+		gFrameDt = std::chrono::duration<float>(now - lastFrameTime).count();
+		lastFrameTime = now;
 
 		//gSolver.printSolverInfo();
 
@@ -325,7 +584,7 @@ int main( int argc, char* args[] ){
 								<< std::chrono::duration_cast<std::chrono::milliseconds>(now.time_since_epoch()).count()
 								<< " ms\n";
 						
-						gSolver.activateNewParticle(gParticleIndexToActivate);
+						gSimulationThread.requestParticleActivation(gParticleIndexToActivate);
 
 						lastActionTime = now;
 
@@ -337,33 +596,56 @@ int main( int argc, char* args[] ){
 
 		Input(); // Handle Input
 
-		
+		gSimulationThread.setPaused(gPause);
 
-		if (!gPause) {
-			gSolver.update(gScene.getBox(), gCounter); // Optional TODO: should be getGBox
+		// Draw the most recent completed solver frame while the solver works on the next one,
+		// interpolated towards it from the frame before by how far we are into the next step
+		// (keeps drawing while paused so the camera can still move around the frozen simulation)
+		const ParticleSnapshot& snapshot = gSimulationThread.getLatestSnapshot();
+		float alpha = 1.0f;
+		if (snapshot.stepDt > 0.0f) {
+			alpha = std::chrono::duration<float>(clock::now() - snapshot.stepTime).count() / snapshot.stepDt;
+			alpha = glm::clamp(alpha, 0.0f, 1.0f);
+		}
+		gRenderer.setSnapshot(&snapshot, alpha);
 
-			//auto t1 = std::chrono::high_resolution_clock::now();
-			//std::cout << "gSolver.update(): " << std::chrono::duration<double, std::milli>(t1 - t0).count() << " ms\n";
+		if (gRayMarchPreview && gScreenSpaceFluid) {
+			gRenderer.RenderScene_ScreenSpaceFluid();
+		}
+		else if (gRayMarchPreview) {
+			gRenderer.setRayMarchScale(gViewMoving ? gRayMarchScaleMoving : 1.0f);
+			gRenderer.RenderScene_RayMarch();
+		}
+		else {
+			gRenderer.RenderScene();
+		}
 
-			//gRenderer.RenderScene();
+		//auto t2 = std::chrono::high_resolution_clock::now();
+		//std::cout << "gRenderer.RenderScene(): " << std::chrono::duration<double, std::milli>(t2 - t1).count() << " ms\n";
 
-			//auto t2 = std::chrono::high_resolution_clock::now();
-			//std::cout << "gRenderer.RenderScene(): " << std::chrono::duration<double, std::milli>(t2 - t1).count() << " ms\n";
+		//Update screen of our specified window
+		SDL_GL_SwapWindow(gGraphicsApplicationWindow);
 
-			gRenderer.RenderScene_RayMarch();
-
-			//Update screen of our specified window
-			SDL_GL_SwapWindow(gGraphicsApplicationWindow);
+		if (!firstFrameShown) {
+			firstFrameShown = true;
+			auto firstFrameTime = std::chrono::high_resolution_clock::now();
+			std::cout << "Time to first frame: "
+					  << std::chrono::duration<double, std::milli>(firstFrameTime - startupTime).count() << " ms\n";
 		}
 
 		updateFPS();
 
-		std::cout << "FPS: " << fps << std::endl;
-		
-		SDL_Delay(0.1); 
-
-		// Sleep to reduce CPU usage
-		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+		// Without vsync, hold the target frame rate by waiting for the next frame deadline
+		if (!gVsync && gTargetFPS > 0) {
+			nextFrameTime += frameDuration;
+			auto frameEnd = clock::now();
+			if (nextFrameTime > frameEnd) {
+				std::this_thread::sleep_until(nextFrameTime);
+			}
+			else {
+				nextFrameTime = frameEnd; // running behind - do not try to make up for lost frames
+			}
+		}
 		gCounter++;
 	}
 